@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "bbmp_parser.h"
+#include "bbmp_helper.h"
+#include "bbmp_compare.h"
+#include "bbmp_parallel.h"
+
+/*
+ * Image comparison metrics: exact diff, MSE/PSNR and SSIM. 
+ * Every metric works on either two parsed bbmp_Image instances or two raw BMP buffers, in which case the rows 
+ * are read straight out of the raw pixelarray (skipping the padding bytes), without parsing the image first.
+ * Rows are split into bands that are compared in parallel.
+*/
+
+#define BBMP_COMPARE_GRAIN (64) //minimum number of rows per band
+#define BBMP_SSIM_WINDOW (8) //side of the square SSIM window, in pixels
+#define BBMP_SSIM_STEP (4) //distance between neighbouring SSIM windows, in pixels
+#define BBMP_SSIM_C1 ((0.01 * 255) * (0.01 * 255))
+#define BBMP_SSIM_C2 ((0.03 * 255) * (0.03 * 255))
+
+/*
+ * Uniform view over the rows of either a parsed or a raw pixelarray.
+*/
+struct bbmp_RowSource {
+    const uint8_t *base; //start of the raw pixelarray, NULL if "rows" is used
+    size_t stride; //bytes per raw row, including padding
+    bbmp_PixelArray rows; //rows of a parsed pixelarray, NULL if "base" is used
+    uint16_t step; //bytes per pixel
+    uint8_t r_off, g_off, b_off; //offsets of each channel within a pixel
+    int32_t width, height;
+}; typedef struct bbmp_RowSource bbmp_RowSource;
+
+static inline const uint8_t *bbmp_source_row(const bbmp_RowSource *src, size_t y) {
+    return src->rows ? (const uint8_t *) src->rows[y] : src->base + y * src->stride;
+}
+
+static void bbmp_luma_row(const uint8_t *restrict row, const bbmp_RowSource *src, size_t width, uint8_t *restrict luma) {
+    /* 
+     * Save the luma of the "width" pixels of "row" to "luma", using an integer approximation of the 0.299, 0.587, 0.114 weights used by bbmp_grayscale.
+     * Every layout gets its own loop with a constant pixel step and constant channel offsets: read through src->step and the 
+     * offset fields, every load would be a gather the compiler can't vectorize.
+    */
+
+    if (src->step == 4) {
+        for (size_t x = 0; x < width; x++) luma[x] = (77 * row[x * 4 + 2] + 150 * row[x * 4 + 1] + 29 * row[x * 4]) >> 8;
+    } else if (src->r_off == 0) {
+        for (size_t x = 0; x < width; x++) luma[x] = (77 * row[x * 3] + 150 * row[x * 3 + 1] + 29 * row[x * 3 + 2]) >> 8;
+    } else {
+        for (size_t x = 0; x < width; x++) luma[x] = (77 * row[x * 3 + 2] + 150 * row[x * 3 + 1] + 29 * row[x * 3]) >> 8;
+    }
+}
+
+static bool bbmp_source_image(const bbmp_Image *img, bbmp_RowSource *src) {
+    if (!img || !img->pixelarray) return false;
+
+    *src = (bbmp_RowSource) {
+        .rows = img->pixelarray,
+        .step = sizeof(bbmp_Pixel),
+        .r_off = offsetof(bbmp_Pixel, r),
+        .g_off = offsetof(bbmp_Pixel, g),
+        .b_off = offsetof(bbmp_Pixel, b),
+        .width = img->metadata.pixelarray_width,
+        .height = img->metadata.pixelarray_height
+    };
+
+    return true;
+}
+
+static bool bbmp_source_raw(const uint8_t *raw_bmp_data, bbmp_RowSource *src) {
+    if (!raw_bmp_data) return false;
+
+    bbmp_Metadata meta;
+    bbmp_parse_bmp_metadata((unsigned char *) raw_bmp_data, &meta);
+
+    if (meta.bpp != 24 && meta.bpp != 32) return false;
+
+    *src = (bbmp_RowSource) {
+        .base = raw_bmp_data + meta.pixelarray_off,
+        .stride = meta.Bpr,
+        .step = meta.Bpp,
+        .b_off = 0,
+        .g_off = 1,
+        .r_off = 2,
+        .width = meta.pixelarray_width,
+        .height = meta.pixelarray_height
+    };
+
+    return true;
+}
+
+static bool bbmp_source_match(const bbmp_RowSource *a, const bbmp_RowSource *b) {
+    // both sources must describe pixelarrays of the same dimensions and layout
+    return a->width == b->width && a->height == b->height && a->step == b->step && a->width > 0 && a->height > 0;
+}
+
+// ------------------------------------------ exact diff
+
+struct bbmp_DiffBand {
+    bool found;
+    bbmp_Diff diff;
+}; typedef struct bbmp_DiffBand bbmp_DiffBand;
+
+struct bbmp_DiffCtx {
+    const bbmp_RowSource *a, *b;
+    bool first_only;
+    atomic_long first_row; //lowest row known to contain a difference, used for early exit
+    bbmp_DiffBand bands[BBMP_PARALLEL_MAX_BANDS];
+}; typedef struct bbmp_DiffCtx bbmp_DiffCtx;
+
+static void bbmp_diff_band(void *arg, size_t band, size_t begin, size_t end) {
+    bbmp_DiffCtx *ctx = arg;
+    bbmp_DiffBand *res = &ctx->bands[band];
+    const size_t step = ctx->a->step,
+                 row_bytes = ctx->a->width * step;
+
+    for (size_t y = begin; y < end; y++) {
+        // a lower band already found a difference, nothing in this band can come first
+        if (ctx->first_only && (long) y >= atomic_load_explicit(&ctx->first_row, memory_order_relaxed)) break;
+
+        const uint8_t *ra = bbmp_source_row(ctx->a, y),
+                      *rb = bbmp_source_row(ctx->b, y);
+
+        if (!memcmp(ra, rb, row_bytes)) continue;
+
+        // the row differs, locate the leftmost and rightmost differing pixels; the pixels in between don't affect the result
+        size_t x0 = 0,
+               x1 = ctx->a->width - 1;
+
+        while (!memcmp(ra + x0 * step, rb + x0 * step, step)) x0++;
+        while (!memcmp(ra + x1 * step, rb + x1 * step, step)) x1--;
+
+        if (!res->found) {
+            res->found = true;
+            res->diff.first_x = x0;
+            res->diff.first_y = y;
+            res->diff.min_x = x0;
+            res->diff.max_x = x1;
+            res->diff.min_y = y;
+        }
+
+        if ((int32_t) x0 < res->diff.min_x) res->diff.min_x = x0;
+        if ((int32_t) x1 > res->diff.max_x) res->diff.max_x = x1;
+        res->diff.max_y = y;
+
+        if (ctx->first_only) {
+            long cur = atomic_load(&ctx->first_row);
+            while ((long) y < cur && !atomic_compare_exchange_weak(&ctx->first_row, &cur, (long) y));
+            break;
+        }
+    }
+}
+
+static bool bbmp_diff_sources(const bbmp_RowSource *a, const bbmp_RowSource *b, bool first_only, bbmp_Diff *result) {
+    if (!result || !bbmp_source_match(a, b)) return false;
+
+    bbmp_DiffCtx *ctx = calloc(1, sizeof(bbmp_DiffCtx));
+    if (!ctx) {
+        perror("bbmp_compare: Failed allocating memory: ");
+        return false;
+    }
+
+    ctx->a = a;
+    ctx->b = b;
+    ctx->first_only = first_only;
+    atomic_init(&ctx->first_row, a->height);
+
+    const size_t bands = bbmp_parallel_for(a->height, BBMP_COMPARE_GRAIN, bbmp_diff_band, ctx);
+
+    *result = (bbmp_Diff) {.identical = true};
+
+    // bands are in row order, so the first band that found anything holds the first differing pixel
+    for (size_t i = 0; i < bands; i++) {
+        const bbmp_DiffBand *res = &ctx->bands[i];
+        if (!res->found) continue;
+
+        if (result->identical) {
+            *result = res->diff;
+            result->identical = false;
+            if (first_only) break;
+            continue;
+        }
+
+        if (res->diff.min_x < result->min_x) result->min_x = res->diff.min_x;
+        if (res->diff.max_x > result->max_x) result->max_x = res->diff.max_x;
+        result->max_y = res->diff.max_y;
+    }
+
+    free(ctx);
+
+    return true;
+}
+
+bool bbmp_diff(const bbmp_Image *a, const bbmp_Image *b, bool first_only, bbmp_Diff *result) {
+    /* 
+     * Compare the pixelarrays of "a" and "b" pixel by pixel and save the result to *result.
+     * If "first_only" is true, the comparison stops at the first differing row, and the bounding box only covers that row.
+     * Both images must have the same dimensions. Returns true on success.
+    */
+
+    bbmp_RowSource src_a, src_b;
+    if (!bbmp_source_image(a, &src_a) || !bbmp_source_image(b, &src_b)) return false;
+
+    return bbmp_diff_sources(&src_a, &src_b, first_only, result);
+}
+
+bool bbmp_diff_raw(const uint8_t *raw_a, const uint8_t *raw_b, bool first_only, bbmp_Diff *result) {
+    /* 
+     * Same as bbmp_diff(), but compares two raw BMP images (entire file data) without parsing their pixelarrays.
+     * Both images must have the same dimensions and color depth (24 or 32 bpp). For 32bpp images, all 4 bytes of each pixel are compared.
+    */
+
+    bbmp_RowSource src_a, src_b;
+    if (!bbmp_source_raw(raw_a, &src_a) || !bbmp_source_raw(raw_b, &src_b)) return false;
+
+    return bbmp_diff_sources(&src_a, &src_b, first_only, result);
+}
+
+// ------------------------------------------ MSE / PSNR
+
+struct bbmp_MseCtx {
+    const bbmp_RowSource *a, *b;
+    uint64_t sums[BBMP_PARALLEL_MAX_BANDS];
+}; typedef struct bbmp_MseCtx bbmp_MseCtx;
+
+static void bbmp_mse_band(void *arg, size_t band, size_t begin, size_t end) {
+    bbmp_MseCtx *ctx = arg;
+    const size_t width = ctx->a->width;
+    uint64_t sum = 0;
+
+    for (size_t y = begin; y < end; y++) {
+        const uint8_t *restrict ra = bbmp_source_row(ctx->a, y),
+                      *restrict rb = bbmp_source_row(ctx->b, y);
+
+        if (ctx->a->step == 3) {
+            // every byte of the row is a color channel, so the row can be treated as a flat byte array
+            for (size_t i = 0; i < width * 3; i++) {
+                const int32_t d = ra[i] - rb[i];
+                sum += d * d;
+            }
+        } else {
+            for (size_t x = 0; x < width * 4; x += 4) {
+                const int32_t d0 = ra[x] - rb[x],
+                              d1 = ra[x + 1] - rb[x + 1],
+                              d2 = ra[x + 2] - rb[x + 2];
+                sum += d0 * d0 + d1 * d1 + d2 * d2;
+            }
+        }
+    }
+
+    ctx->sums[band] = sum;
+}
+
+static bool bbmp_psnr_sources(const bbmp_RowSource *a, const bbmp_RowSource *b, double *mse, double *psnr) {
+    if (!bbmp_source_match(a, b) || (!mse && !psnr)) return false;
+
+    bbmp_MseCtx ctx = {.a = a, .b = b};
+    const size_t bands = bbmp_parallel_for(a->height, BBMP_COMPARE_GRAIN, bbmp_mse_band, &ctx);
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < bands; i++) sum += ctx.sums[i];
+
+    const double err = (double) sum / ((double) a->width * a->height * 3);
+
+    if (mse) *mse = err;
+    if (psnr) *psnr = err == 0 ? INFINITY : 10 * log10(255.0 * 255.0 / err);
+
+    return true;
+}
+
+bool bbmp_psnr(const bbmp_Image *a, const bbmp_Image *b, double *mse, double *psnr) {
+    /* 
+     * Calculate the mean squared error (over all color channels) and the peak signal-to-noise ratio (in dB) of "b" relative to "a", 
+     * and save them to *mse and *psnr respectively. Either pointer may be NULL if the value isn't needed.
+     * If the images are identical, the PSNR is INFINITY. Both images must have the same dimensions. Returns true on success.
+    */
+
+    bbmp_RowSource src_a, src_b;
+    if (!bbmp_source_image(a, &src_a) || !bbmp_source_image(b, &src_b)) return false;
+
+    return bbmp_psnr_sources(&src_a, &src_b, mse, psnr);
+}
+
+bool bbmp_psnr_raw(const uint8_t *raw_a, const uint8_t *raw_b, double *mse, double *psnr) {
+    /* 
+     * Same as bbmp_psnr(), but works on two raw BMP images (entire file data) of the same dimensions and color depth (24 or 32 bpp).
+     * The fourth byte of 32bpp pixels is ignored.
+    */
+
+    bbmp_RowSource src_a, src_b;
+    if (!bbmp_source_raw(raw_a, &src_a) || !bbmp_source_raw(raw_b, &src_b)) return false;
+
+    return bbmp_psnr_sources(&src_a, &src_b, mse, psnr);
+}
+
+// ------------------------------------------ SSIM
+
+struct bbmp_SsimCtx {
+    const bbmp_RowSource *a, *b;
+    size_t win_w, win_h; //window dimensions, smaller than BBMP_SSIM_WINDOW only for tiny images
+    size_t win_cols; //number of windows per window row
+    bool failed[BBMP_PARALLEL_MAX_BANDS]; //per band, like sums, so that bands never write the same memory
+    double sums[BBMP_PARALLEL_MAX_BANDS];
+}; typedef struct bbmp_SsimCtx bbmp_SsimCtx;
+
+static void bbmp_ssim_accumulate(const uint8_t *restrict la, const uint8_t *restrict lb, size_t width, uint32_t *restrict sa, uint32_t *restrict sb, 
+                                 uint32_t *restrict saa, uint32_t *restrict sbb, uint32_t *restrict sab) {
+    // add one row of lumas to the per-column sums; restrict only holds for parameters, so this is a function of its own to be vectorized
+    for (size_t x = 0; x < width; x++) {
+        sa[x] += la[x];
+        sb[x] += lb[x];
+        saa[x] += (uint32_t) la[x] * la[x];
+        sbb[x] += (uint32_t) lb[x] * lb[x];
+        sab[x] += (uint32_t) la[x] * lb[x];
+    }
+}
+
+static void bbmp_ssim_band(void *arg, size_t band, size_t begin, size_t end) {
+    /* 
+     * Handle window rows [begin, end). For every window row, per-column sums of both lumas, their squares and their product are 
+     * accumulated over the rows of the window first, after which every window only has to add up win_w columns.
+    */
+
+    bbmp_SsimCtx *ctx = arg;
+    const size_t width = ctx->a->width;
+
+    // per-column sums, followed by the lumas of the current row of both images
+    uint32_t *cols = malloc(5 * width * sizeof(uint32_t) + 2 * width);
+    if (!cols) {
+        ctx->failed[band] = true;
+        return;
+    }
+
+    uint32_t *sa = cols,
+             *sb = cols + width,
+             *saa = cols + 2 * width,
+             *sbb = cols + 3 * width,
+             *sab = cols + 4 * width;
+    uint8_t *luma_a = (uint8_t *) (cols + 5 * width),
+            *luma_b = luma_a + width;
+
+    const double n = ctx->win_w * ctx->win_h;
+    double total = 0;
+
+    for (size_t wy = begin; wy < end; wy++) {
+        memset(cols, 0, 5 * width * sizeof(uint32_t));
+
+        for (size_t y = wy * BBMP_SSIM_STEP; y < wy * BBMP_SSIM_STEP + ctx->win_h; y++) {
+            bbmp_luma_row(bbmp_source_row(ctx->a, y), ctx->a, width, luma_a);
+            bbmp_luma_row(bbmp_source_row(ctx->b, y), ctx->b, width, luma_b);
+            bbmp_ssim_accumulate(luma_a, luma_b, width, sa, sb, saa, sbb, sab);
+        }
+
+        for (size_t wx = 0; wx < ctx->win_cols; wx++) {
+            uint64_t s_a = 0, s_b = 0, s_aa = 0, s_bb = 0, s_ab = 0;
+
+            for (size_t x = wx * BBMP_SSIM_STEP; x < wx * BBMP_SSIM_STEP + ctx->win_w; x++) {
+                s_a += sa[x];
+                s_b += sb[x];
+                s_aa += saa[x];
+                s_bb += sbb[x];
+                s_ab += sab[x];
+            }
+
+            const double mu_a = s_a / n,
+                         mu_b = s_b / n,
+                         var_a = s_aa / n - mu_a * mu_a,
+                         var_b = s_bb / n - mu_b * mu_b,
+                         cov = s_ab / n - mu_a * mu_b;
+
+            total += ((2 * mu_a * mu_b + BBMP_SSIM_C1) * (2 * cov + BBMP_SSIM_C2)) / 
+                     ((mu_a * mu_a + mu_b * mu_b + BBMP_SSIM_C1) * (var_a + var_b + BBMP_SSIM_C2));
+        }
+    }
+
+    free(cols);
+    ctx->sums[band] = total;
+}
+
+static bool bbmp_ssim_sources(const bbmp_RowSource *a, const bbmp_RowSource *b, double *ssim) {
+    if (!ssim || !bbmp_source_match(a, b)) return false;
+
+    bbmp_SsimCtx ctx = {
+        .a = a,
+        .b = b,
+        .win_w = a->width < BBMP_SSIM_WINDOW ? a->width : BBMP_SSIM_WINDOW,
+        .win_h = a->height < BBMP_SSIM_WINDOW ? a->height : BBMP_SSIM_WINDOW
+    };
+
+    ctx.win_cols = (a->width - ctx.win_w) / BBMP_SSIM_STEP + 1;
+    const size_t win_rows = (a->height - ctx.win_h) / BBMP_SSIM_STEP + 1;
+
+    const size_t bands = bbmp_parallel_for(win_rows, BBMP_COMPARE_GRAIN / BBMP_SSIM_STEP, bbmp_ssim_band, &ctx);
+
+    double total = 0;
+    for (size_t i = 0; i < bands; i++) {
+        if (ctx.failed[i]) {
+            fprintf(stderr, "bbmp_compare: Failed allocating memory for SSIM column sums\n");
+            return false;
+        }
+
+        total += ctx.sums[i];
+    }
+
+    *ssim = total / ((double) win_rows * ctx.win_cols);
+
+    return true;
+}
+
+bool bbmp_ssim(const bbmp_Image *a, const bbmp_Image *b, double *ssim) {
+    /* 
+     * Calculate the mean structural similarity index of the lumas of "a" and "b" and save it to *ssim.
+     * The index is averaged over 8x8 windows placed every 4 pixels in both directions; 1.0 means the lumas are identical.
+     * Both images must have the same dimensions. Returns true on success.
+    */
+
+    bbmp_RowSource src_a, src_b;
+    if (!bbmp_source_image(a, &src_a) || !bbmp_source_image(b, &src_b)) return false;
+
+    return bbmp_ssim_sources(&src_a, &src_b, ssim);
+}
+
+bool bbmp_ssim_raw(const uint8_t *raw_a, const uint8_t *raw_b, double *ssim) {
+    /* 
+     * Same as bbmp_ssim(), but works on two raw BMP images (entire file data) of the same dimensions and color depth (24 or 32 bpp).
+    */
+
+    bbmp_RowSource src_a, src_b;
+    if (!bbmp_source_raw(raw_a, &src_a) || !bbmp_source_raw(raw_b, &src_b)) return false;
+
+    return bbmp_ssim_sources(&src_a, &src_b, ssim);
+}
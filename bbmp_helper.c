@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
 
 #include "bbmp_parser.h"
 #include "bbmp_helper.h"
@@ -13,10 +15,23 @@
 
 typedef uint8_t *bbmp_PixelArray_Raw;
 
+/*
+ * Reference count of pixel storage shared between several bbmp_Image instances (views).
+ * It's allocated together with the pixelbuf, so creating a view only has to increment it.
+*/
+struct bbmp_Storage {
+    atomic_size_t refs; //number of images whose rows point into pixelbuf
+};
+
 inline static bbmp_PixelArray_Raw bbmp_get_pixelarray_raw(uint8_t *raw_bmp_data, const struct bbmp_Metadata *metadata, void *dest);
-static bbmp_PixelArray bbmp_get_pixelarray(uint8_t *raw_bmp_data, const struct bbmp_Metadata *metadata); 
+static bool bbmp_get_pixelarray(uint8_t *raw_bmp_data, bbmp_Image *img); 
+static bool bbmp_alloc_storage(bbmp_Image *img, size_t stride, size_t rows_capacity); 
+static void bbmp_release_storage(bbmp_Image *img); 
+static bool bbmp_rect_inside(const bbmp_Image *img, int32_t x, int32_t y, int32_t width, int32_t height); 
 static bbmp_PixelArray_Raw bbmp_convert_pixelarray(const bbmp_PixelArray parsed, const bbmp_Metadata *metadata, bbmp_PixelArray_Raw buffer); 
 static void bbmp_debug_pixelarray_raw(FILE *stream, bbmp_PixelArray_Raw pixarray_raw, const struct bbmp_Metadata *metadata);
+static void bbmp_init_metadata(bbmp_Metadata *meta, int32_t pixelarray_width, int32_t pixelarray_height, uint16_t bpp);
+static void bbmp_write_header(const bbmp_Metadata *meta, uint8_t *raw_bmp_data);
 
 static void bbmp_debug_pixelarray_raw(FILE *stream, bbmp_PixelArray_Raw pixarray_raw, const struct bbmp_Metadata *metadata) {
     /* 
@@ -53,11 +68,36 @@ bool bbmp_get_image(uint8_t *raw_bmp_data, bbmp_Image *location) {
     // parse the metadata and save it to the struct
     bbmp_parse_bmp_metadata(raw_bmp_data, &(location->metadata));
 
-    if ((location->pixelarray = bbmp_get_pixelarray(raw_bmp_data, &(location->metadata))) == NULL) return false;
+    if (!bbmp_get_pixelarray(raw_bmp_data, location)) return false;
 
     return true;
 }
 
+static void bbmp_init_metadata(bbmp_Metadata *meta, int32_t pixelarray_width, int32_t pixelarray_height, uint16_t bpp) {
+    /*
+     * Initialize the metadata properties that bbmp_metaupdate() doesn't touch for a blank image of the passed dimensions and color depth.
+     * The rest of the metadata still has to be calculated by calling bbmp_metaupdate() afterwards.
+    */
+
+    // save pixelarray dimensions and color depth to metadata
+    meta->pixelarray_width = pixelarray_width;
+    meta->pixelarray_height = pixelarray_height;
+    meta->bpp = bpp;
+
+    memcpy(meta->header_iden, BITMAPINFOHEADER_STRING, 3);
+    meta->res1 = 0;
+    meta->res2 = 0;
+    meta->pixelarray_off = HEADER_BYTESIZE + BITMAPINFOHEADER_BYTESIZE;
+    meta->dib_size = BITMAPINFOHEADER_BYTESIZE;
+    meta->panes_num = 1;
+    meta->compression_method = 0;
+    meta->ppm_horiz = 0; 
+    meta->ppm_vert = 0;
+    meta->colors_num = 0;
+    meta->colors_important_num = 0;
+    meta->Bpp = bpp / 8;
+}
+
 bbmp_Image *bbmp_create_image(int32_t pixelarray_width, int32_t pixelarray_height, uint16_t bpp, const bbmp_Pixel *fill, bbmp_Image *location) {
     /*
      * Create a blank instance of a BMP image and save it to *location, which must be a valid pointer to a bbmp_Image structure.
@@ -69,45 +109,16 @@ bbmp_Image *bbmp_create_image(int32_t pixelarray_width, int32_t pixelarray_heigh
 
     if (!location) return false;
     
-    // save pixelarray dimensions and color depth to metadata
-    location->metadata.pixelarray_width = pixelarray_width;
-    location->metadata.pixelarray_height = pixelarray_height;
-    location->metadata.bpp = bpp;
-
-    // update metadata properties that bbmp_metaupdate() doesn't touch
-    memcpy(location->metadata.header_iden, BITMAPINFOHEADER_STRING, 3);
-    location->metadata.res1 = 0;
-    location->metadata.res2 = 0;
-    location->metadata.pixelarray_off = HEADER_BYTESIZE + BITMAPINFOHEADER_BYTESIZE;
-    location->metadata.dib_size = BITMAPINFOHEADER_BYTESIZE;
-    location->metadata.panes_num = 1;
-    location->metadata.compression_method = 0;
-    location->metadata.ppm_horiz = 0; 
-    location->metadata.ppm_vert = 0;
-    location->metadata.colors_num = 0;
-    location->metadata.colors_important_num = 0;
-    location->metadata.Bpp = bpp / 8;
+    bbmp_init_metadata(&location->metadata, pixelarray_width, pixelarray_height, bpp);
 
     // updates Bpr, Bpr_np, padding, resolution, pixelarray_size_np, pixelarray_size and filesize metadata properties
     bbmp_metaupdate(location);
 
-    if (fill) {
-        // allocate and fill pixelarray memory     
-        location->pixelarray = malloc(location->metadata.pixelarray_height * sizeof(bbmp_Pixel *));
-        if (!location->pixelarray) {
-            perror("bbmp_helper: Failed allocating memory\n");
-            return NULL;
-        }
+    // allocate pixelarray memory     
+    if (!bbmp_alloc_storage(location, location->metadata.pixelarray_width, location->metadata.pixelarray_height)) return NULL;
 
+    if (fill) {
         for (bbmp_PixelArray bp = location->pixelarray; bp < location->pixelarray + location->metadata.pixelarray_height; bp++) {
-            *bp = malloc(location->metadata.pixelarray_width * sizeof(bbmp_Pixel));
-
-            if (!(*bp)) {
-                perror("bbmp_helper: Failed allocating memory\n");
-                free(location->pixelarray);
-                return NULL;
-            }
-
             for (bbmp_Pixel *bp_nest = *bp; bp_nest < (*bp) + location->metadata.pixelarray_width; bp_nest++) {
                 bp_nest->r = fill->r;
                 bp_nest->g = fill->g;
@@ -122,65 +133,163 @@ bbmp_Image *bbmp_create_image(int32_t pixelarray_width, int32_t pixelarray_heigh
 bool bbmp_destroy_image(bbmp_Image *location) {
     /*
      * Free all resources allocated by the internal bbmp_Image representation
-     * Namely the bbmp_PixelArray as it lives on the heap, as the metadata is a struct on the stack
+     * Namely the pixel storage and the row pointers of the bbmp_PixelArray as they live on the heap, as the metadata is a struct on the stack
     */
 
     if (!location) return false;
 
-    for (bbmp_PixelArray bp = location->pixelarray; bp < location->pixelarray + (location->metadata).pixelarray_height; bp++) {
-        free(*bp);
-    }
-
+    bbmp_release_storage(location);
     free(location->pixelarray);
 
+    location->pixelarray = NULL;
+    location->stride = 0;
+    location->rows_capacity = 0;
+
     return true;
 }
 
-static bbmp_PixelArray bbmp_get_pixelarray(uint8_t *raw_bmp_data, const struct bbmp_Metadata *metadata) {
+static void bbmp_release_storage(bbmp_Image *img) {
+    // drop the reference "img" holds to its pixel storage, freeing the storage if it was the last one
+
+    if (!img->storage || atomic_fetch_sub(&img->storage->refs, 1) == 1) {
+        free(img->pixelbuf);
+        free(img->storage);
+    }
+
+    img->pixelbuf = NULL;
+    img->storage = NULL;
+}
+
+bool bbmp_is_shared(const bbmp_Image *img) {
+    // check whether the pixel storage of "img" is currently shared with at least one other image
+
+    return img && img->storage && atomic_load(&img->storage->refs) > 1;
+}
+
+bbmp_Image *bbmp_view(bbmp_Image *src, int32_t x, int32_t y, int32_t width, int32_t height, bbmp_Image *location) {
     /* 
-     * Parse raw BMP data pointed to by "raw_bmp_data" and return a 2D array of bbmp_Pixel structs.
-     * The array's 'dimensions' are equal to [metadata->pixelarray_height]*[metadata->pixelarray_width];
-     * The memory allocated by this function must be freed manually, although this is usually done by the API consumer using
-     * bbmp_destroy_image on a bbmp_Image struct.
+     * Create a lightweight view of the "width" x "height" rectangle whose bottom-left corner lies at column "x" and row "y" of "src" and save it to *location.
+     * No pixels are copied: the view gets its own row pointers into the reference counted pixel storage of "src".
+     * Pass the full dimensions of "src" to share the entire image. Views can be viewed again, and are used like any other bbmp_Image.
+     * Whichever image sharing the storage is mutated first through the API receives its own copy of its pixels (copy-on-write), so mutations never 
+     * leak between images. Code modifying pixelarray rows directly must call bbmp_make_unique() first.
+     * The view must be freed with bbmp_destroy_image(); the storage is freed together with the last image referencing it.
+     * Returns NULL on failure or the pointer to location on success.
     */
 
-    if (!raw_bmp_data || !metadata) return NULL;
+    if (!src || !src->pixelarray || !src->storage || !location || src == location || !bbmp_rect_inside(src, x, y, width, height)) return NULL;
 
-    //allocate space for the raw pixelarray
-    bbmp_PixelArray_Raw pixelarray_raw = malloc(metadata->pixelarray_size);
-    if (!pixelarray_raw) {
+    bbmp_PixelArray rows = malloc(height * sizeof(bbmp_Pixel *));
+    if (!rows) {
         perror("bbmp_helper: Failed allocating memory: ");
         return NULL;
     }
 
-    //store the raw pixelarray in the temporary buffer
-    bbmp_get_pixelarray_raw(raw_bmp_data, metadata, pixelarray_raw);
+    atomic_fetch_add(&src->storage->refs, 1);
+
+    for (int32_t n = 0; n < height; n++) {
+        rows[n] = src->pixelarray[y + n] + x;
+    }
+
+    location->metadata = src->metadata;
+    location->metadata.pixelarray_width = width;
+    location->metadata.pixelarray_height = height;
+    bbmp_metaupdate(location);
+
+    location->pixelarray = rows;
+    location->pixelbuf = src->pixelbuf;
+    location->storage = src->storage;
+    // the view may not write past its own columns, so it has no spare capacity
+    location->stride = width;
+    location->rows_capacity = height;
 
-    // allocate space for HEIGHT pointers to pixels
-    bbmp_PixelArray pixelarray_parsed = malloc(metadata->pixelarray_height * sizeof(bbmp_Pixel*));
-    if (!pixelarray_parsed) {
+    return location;
+}
+
+bool bbmp_make_unique(bbmp_Image *img) {
+    /* 
+     * Make sure that "img" is the only image referencing its pixel storage, copying its visible pixels into new storage if it is shared.
+     * Called by every API function that modifies pixels; API consumers only have to call it before modifying pixelarray rows directly.
+     * Returns false on failure, in which case "img" is left untouched.
+    */
+
+    if (!img) return false;
+    if (!bbmp_is_shared(img)) return true;
+
+    bbmp_Image copy;
+    if (!bbmp_alloc_storage(&copy, img->metadata.pixelarray_width, img->metadata.pixelarray_height)) return false;
+
+    for (int32_t n = 0; n < img->metadata.pixelarray_height; n++) {
+        memcpy(copy.pixelarray[n], img->pixelarray[n], img->metadata.pixelarray_width * sizeof(bbmp_Pixel));
+    }
+
+    bbmp_release_storage(img);
+    free(img->pixelarray);
+
+    img->pixelarray = copy.pixelarray;
+    img->pixelbuf = copy.pixelbuf;
+    img->storage = copy.storage;
+    img->stride = copy.stride;
+    img->rows_capacity = copy.rows_capacity;
+
+    return true;
+}
+
+static bool bbmp_alloc_storage(bbmp_Image *img, size_t stride, size_t rows_capacity) {
+    /* 
+     * Allocate contiguous pixel storage of "rows_capacity" rows, "stride" pixels each, and the matching row pointers, 
+     * along with its reference count (one, held by "img"), and save them to the bbmp_Image pointed to by "img". The pixel memory is left uninitialized.
+     * Any storage the image previously held is not freed. Returns false on failure, in which case "img" is left untouched.
+    */
+
+    bbmp_Pixel *pixelbuf = malloc(stride * rows_capacity * sizeof(bbmp_Pixel));
+    bbmp_PixelArray pixelarray = malloc(rows_capacity * sizeof(bbmp_Pixel *));
+    struct bbmp_Storage *storage = malloc(sizeof(struct bbmp_Storage));
+
+    if (!pixelbuf || !pixelarray || !storage) {
         perror("bbmp_helper: Failed allocating memory: ");
-        free(pixelarray_raw);
-        return NULL;
+        free(pixelbuf);
+        free(pixelarray);
+        free(storage);
+        return false;
     }
-     
-    //raw row pointer
-    bbmp_PixelArray_Raw bp_raw = pixelarray_raw;
-
-    // initialize each HEIGHT row
-    for (bbmp_PixelArray bp = pixelarray_parsed; bp < pixelarray_parsed + metadata->pixelarray_height; bp++) {
-        // make each pointer point to a memory location large enough to hold WIDTH instances of bbmp_Pixel
-        *bp = malloc(metadata->pixelarray_width * sizeof(bbmp_Pixel));
-        if (!(*bp)) {
-            perror("bbmp_helper: Failed allocating memory: ");
-            free(pixelarray_raw); 
-            free(pixelarray_parsed);
-            return NULL;
-        }
 
+    atomic_init(&storage->refs, 1);
+
+    for (size_t n = 0; n < rows_capacity; n++) {
+        pixelarray[n] = pixelbuf + n * stride;
+    }
+
+    img->pixelbuf = pixelbuf;
+    img->pixelarray = pixelarray;
+    img->storage = storage;
+    img->stride = stride;
+    img->rows_capacity = rows_capacity;
+
+    return true;
+}
+
+static bool bbmp_get_pixelarray(uint8_t *raw_bmp_data, bbmp_Image *img) {
+    /* 
+     * Parse raw BMP data pointed to by "raw_bmp_data" into the pixelarray of "img", a 2D array of bbmp_Pixel structs.
+     * The array's 'dimensions' are equal to [metadata->pixelarray_height]*[metadata->pixelarray_width];
+     * The memory allocated by this function must be freed manually, although this is usually done by the API consumer using
+     * bbmp_destroy_image on a bbmp_Image struct.
+    */
+
+    if (!raw_bmp_data || !img) return false;
+
+    const bbmp_Metadata *metadata = &img->metadata;
+
+    if (!bbmp_alloc_storage(img, metadata->pixelarray_width, metadata->pixelarray_height)) return false;
+
+    //raw row pointer, rows are converted straight out of the raw data
+    bbmp_PixelArray_Raw bp_raw = raw_bmp_data + metadata->pixelarray_off;
+
+    // fill each row 
+    for (bbmp_PixelArray bp = img->pixelarray; bp < img->pixelarray + metadata->pixelarray_height; bp++) {
         bbmp_PixelArray_Raw bp_raw_nest = bp_raw;
 
-        // fill each allocated row 
         for (bbmp_Pixel *bp_nest = *bp; bp_nest < (*bp) + metadata->pixelarray_width; bp_nest++) {
             bp_nest->b = bp_raw_nest[0];
             bp_nest->g = bp_raw_nest[1];
@@ -192,8 +301,7 @@ static bbmp_PixelArray bbmp_get_pixelarray(uint8_t *raw_bmp_data, const struct b
         bp_raw += metadata->Bpr;
     }
     
-    free(pixelarray_raw);
-    return pixelarray_parsed;
+    return true;
 }
 
 static bbmp_PixelArray_Raw bbmp_convert_pixelarray(const bbmp_PixelArray parsed, const bbmp_Metadata *metadata, bbmp_PixelArray_Raw buffer) {
@@ -254,7 +362,7 @@ bool bbmp_enlarge_pixelarray(bbmp_Image *img, int32_t width, int32_t height, con
     /* 
      * Dynamically update the size of the pixelarray of the associated bbmp_Image instance pointed to by `img`. 
      * If either of the passed dimensions is lower than that of the current pixelarray, the function returns false. 
-     * If either is larger, the pixelarray is resized and reallocated, and the metadata is updated using bbmp_metaupdate.
+     * If either is larger, the pixelarray is resized using bbmp_resize_canvas, and the metadata is updated using bbmp_metaupdate.
      * When either passed dimension is larger, the new blank rows/columns are appended to the top/right of the image respectively, and their pixels values
      * are initialized to that of the "fill" reference pixel. 
      * Returns true on success.
@@ -262,55 +370,194 @@ bool bbmp_enlarge_pixelarray(bbmp_Image *img, int32_t width, int32_t height, con
     
     if ((!img || !fill) || height < img->metadata.pixelarray_height || width < img->metadata.pixelarray_width) return false;
 
-    int32_t prev_width = img->metadata.pixelarray_width,
-            prev_height = img->metadata.pixelarray_height;
+    return bbmp_resize_canvas(img, 0, width - img->metadata.pixelarray_width, 0, height - img->metadata.pixelarray_height, fill);
+}
 
-    //update metadata with new dimensions
-    img->metadata.pixelarray_width = width;
-    img->metadata.pixelarray_height = height;
-    
-    //update rest of the metadata based on the new dimension(s)
-    bbmp_metaupdate(img);
-    
-    if (height > prev_height) {
-        img->pixelarray = realloc(img->pixelarray, img->metadata.pixelarray_height * sizeof(bbmp_Pixel *));
-        if (!img->pixelarray) { 
-            perror("bbmp_helper: Error enlarging HEIGHT dimension of pixelarray: ");
+static void bbmp_reverse_rows(bbmp_PixelArray start, bbmp_PixelArray end) {
+    // reverse the order of the row pointers in [start, end)
+    while (start < end && start < --end) {
+        bbmp_Pixel *t = *start;
+        *start++ = *end;
+        *end = t;
+    }
+}
+
+static void bbmp_rotate_rows(bbmp_PixelArray start, size_t n, size_t shift) {
+    // rotate the n row pointers starting at "start" left by "shift" places, in place
+    bbmp_reverse_rows(start, start + shift);
+    bbmp_reverse_rows(start + shift, start + n);
+    bbmp_reverse_rows(start, start + n);
+}
+
+static void bbmp_fill_row(bbmp_Pixel *row, size_t n, const bbmp_Pixel *fill) {
+    for (bbmp_Pixel *bp = row; bp < row + n; bp++) {
+        *bp = *fill;
+    }
+}
+
+bool bbmp_resize_canvas(bbmp_Image *img, int32_t left, int32_t right, int32_t bottom, int32_t top, const bbmp_Pixel *fill) {
+    /* 
+     * Resize the canvas of the bbmp_Image pointed to by "img" independently on each of its four sides. 
+     * A positive amount pads that side with columns/rows initialized to the "fill" reference pixel, and a negative amount crops that many columns/rows off of it.
+     * "bottom" refers to the first rows of the pixelarray and "top" to the last, as they are stored in the file.
+     * "fill" may only be NULL if nothing is padded. At least one row and column of the original image must remain. 
+     * 
+     * The pixel storage over-allocates both its stride and its number of rows geometrically, so repeatedly growing an image costs amortized O(1) per added pixel.
+     * Shrinking never reallocates. On failure, false is returned and the image is left unchanged. The metadata is updated using bbmp_metaupdate.
+    */
+
+    if (!img || !img->pixelarray) return false;
+
+    const int64_t w = img->metadata.pixelarray_width,
+                  h = img->metadata.pixelarray_height,
+                  new_w = w + left + right,
+                  new_h = h + bottom + top,
+                  pad_l = left > 0 ? left : 0,
+                  pad_b = bottom > 0 ? bottom : 0,
+                  crop_l = left < 0 ? -(int64_t) left : 0,
+                  crop_b = bottom < 0 ? -(int64_t) bottom : 0,
+                  keep_w = w - crop_l - (right < 0 ? -(int64_t) right : 0),
+                  keep_h = h - crop_b - (top < 0 ? -(int64_t) top : 0);
+
+    if (keep_w <= 0 || keep_h <= 0 || new_w > INT32_MAX || new_h > INT32_MAX) return false;
+    if (!fill && (new_w != keep_w || new_h != keep_h)) return false;
+
+    if (bbmp_is_shared(img) && new_w == keep_w && new_h == keep_h) {
+        // cropping shared storage only moves the row pointers of this image, nothing is copied
+        memmove(img->pixelarray, img->pixelarray + crop_b, keep_h * sizeof(bbmp_Pixel *));
+
+        for (int64_t n = 0; n < keep_h; n++) {
+            img->pixelarray[n] += crop_l;
+        }
+
+        img->stride = keep_w;
+        img->rows_capacity = keep_h;
+    } else if (bbmp_is_shared(img) || (size_t) new_w > img->stride || (size_t) new_h > img->rows_capacity) {
+        // grow (or unshare) the storage and move the kept rows and columns straight to their new positions
+        bbmp_Image grown;
+
+        if (!bbmp_alloc_storage(&grown, 
+                                (size_t) new_w > img->stride ? ((size_t) new_w > 2 * img->stride ? (size_t) new_w : 2 * img->stride) : img->stride,
+                                (size_t) new_h > img->rows_capacity ? ((size_t) new_h > 2 * img->rows_capacity ? (size_t) new_h : 2 * img->rows_capacity) : img->rows_capacity)) {
             return false;
         }
 
-        // initialize new pointers with more rows and fill those rows with the reference pixel
-        for (bbmp_PixelArray bp = img->pixelarray + prev_height; bp < img->pixelarray + height; bp++) {
-            *bp = malloc(img->metadata.pixelarray_width * sizeof(bbmp_Pixel));
-            if (!(*bp)) {
-                perror("bbmp_helper: Error enlarging HEIGHT dimension of pixelarray: ");
-                return false;
-            }
+        for (int64_t n = 0; n < new_h; n++) {
+            bbmp_Pixel *row = grown.pixelarray[n];
 
-            for (bbmp_Pixel *bp_nest = *bp; bp_nest < *bp + img->metadata.pixelarray_width; bp_nest++) {
-                bp_nest->b = fill->b;
-                bp_nest->g = fill->g;
-                bp_nest->r = fill->r;
+            if (n < pad_b || n >= pad_b + keep_h) {
+                bbmp_fill_row(row, new_w, fill);
+                continue;
             }
+
+            memcpy(row + pad_l, img->pixelarray[n - pad_b + crop_b] + crop_l, keep_w * sizeof(bbmp_Pixel));
+            bbmp_fill_row(row, pad_l, fill);
+            bbmp_fill_row(row + pad_l + keep_w, new_w - pad_l - keep_w, fill);
         }
-    }
 
-    if (width > prev_width) {
-        for (bbmp_PixelArray bp = img->pixelarray; bp < img->pixelarray + img->metadata.pixelarray_height; bp++) {
-            *bp = realloc(*bp, img->metadata.pixelarray_width * sizeof(bbmp_Pixel));
-            if (!(*bp)) {
-                perror("bbmp_helper: Error enlarging WIDTH dimension of pixelarray: ");
-                return false;
-            }
+        bbmp_release_storage(img);
+        free(img->pixelarray);
 
-            for (bbmp_Pixel *bp_nest = *bp + prev_width; bp_nest < *bp + img->metadata.pixelarray_width; bp_nest++) {
-                bp_nest->b = fill->b;
-                bp_nest->g = fill->g;
-                bp_nest->r = fill->r;
+        img->pixelbuf = grown.pixelbuf;
+        img->pixelarray = grown.pixelarray;
+        img->storage = grown.storage;
+        img->stride = grown.stride;
+        img->rows_capacity = grown.rows_capacity;
+    } else {
+        /* 
+         * Everything fits into the current storage. The row pointers always hold a permutation of all rows_capacity row slots, 
+         * so the cropped rows and the unused slots are rotated out of the way (without allocating) and reused as padding rows.
+        */
+
+        // [kept rows][cropped and unused slots]
+        bbmp_rotate_rows(img->pixelarray, h, crop_b);
+        // [bottom padding][kept rows][cropped and unused slots]
+        bbmp_rotate_rows(img->pixelarray, keep_h + pad_b, keep_h);
+
+        for (int64_t n = 0; n < new_h; n++) {
+            bbmp_Pixel *row = img->pixelarray[n];
+
+            if (n < pad_b || n >= pad_b + keep_h) {
+                bbmp_fill_row(row, new_w, fill);
+                continue;
             }
+
+            if (pad_l != crop_l) memmove(row + pad_l, row + crop_l, keep_w * sizeof(bbmp_Pixel));
+            bbmp_fill_row(row, pad_l, fill);
+            bbmp_fill_row(row + pad_l + keep_w, new_w - pad_l - keep_w, fill);
         }
     }
-    
+
+    img->metadata.pixelarray_width = new_w;
+    img->metadata.pixelarray_height = new_h;
+    bbmp_metaupdate(img);
+
+    return true;
+}
+
+static bool bbmp_rect_inside(const bbmp_Image *img, int32_t x, int32_t y, int32_t width, int32_t height) {
+    // check whether the rectangle lies entirely within the pixelarray of "img" and is non-empty
+    return x >= 0 && y >= 0 && width > 0 && height > 0 && 
+           width <= img->metadata.pixelarray_width - x && height <= img->metadata.pixelarray_height - y;
+}
+
+bbmp_Image *bbmp_copy_rect(const bbmp_Image *src, int32_t x, int32_t y, int32_t width, int32_t height, bbmp_Image *location) {
+    /* 
+     * Copy the "width" x "height" rectangle whose bottom-left corner lies at column "x" and row "y" of the pixelarray of "src" 
+     * into a newly created image saved to *location. Rows are counted from the bottom of the image, in the order they are stored in the file.
+     * The rectangle must lie entirely within the pixelarray of "src".
+     * The new image must be freed with bbmp_destroy_image(). Returns NULL on failure or the pointer to location on success.
+    */
+
+    if (!src || !location || src == location || !bbmp_rect_inside(src, x, y, width, height)) return NULL;
+
+    if (!bbmp_create_image(width, height, src->metadata.bpp, NULL, location)) return NULL;
+
+    for (int32_t n = 0; n < height; n++) {
+        memcpy(location->pixelarray[n], src->pixelarray[y + n] + x, width * sizeof(bbmp_Pixel));
+    }
+
+    return location;
+}
+
+bool bbmp_crop(bbmp_Image *img, int32_t x, int32_t y, int32_t width, int32_t height) {
+    /* 
+     * Crop the pixelarray of "img" in place to the "width" x "height" rectangle whose bottom-left corner lies at column "x" and row "y".
+     * The rectangle must lie entirely within the pixelarray. The storage is kept and reused by subsequent resizes.
+     * The metadata is updated using bbmp_metaupdate. Returns true on success.
+    */
+
+    if (!img || !bbmp_rect_inside(img, x, y, width, height)) return false;
+
+    return bbmp_resize_canvas(img, -x, -(img->metadata.pixelarray_width - x - width), -y, -(img->metadata.pixelarray_height - y - height), NULL);
+}
+
+bool bbmp_paste(bbmp_Image *dest, const bbmp_Image *src, int32_t x, int32_t y) {
+    /* 
+     * Paste the entire pixelarray of "src" into the pixelarray of "dest", placing its bottom-left corner at column "x" and row "y".
+     * The offsets may be negative, and the parts of "src" that don't fit into "dest" are clipped. 
+     * "dest" and "src" must not be the same image. Returns true on success, even if the entirety of "src" was clipped.
+    */
+
+    if (!dest || !src || dest == src || !bbmp_make_unique(dest)) return false;
+
+    // clip the source rectangle to the bounds of the destination
+    const int32_t src_x = x < 0 ? -x : 0,
+                  src_y = y < 0 ? -y : 0,
+                  dest_x = x < 0 ? 0 : x,
+                  dest_y = y < 0 ? 0 : y;
+
+    const int64_t width = (int64_t) src->metadata.pixelarray_width - src_x < (int64_t) dest->metadata.pixelarray_width - dest_x ? 
+                          (int64_t) src->metadata.pixelarray_width - src_x : (int64_t) dest->metadata.pixelarray_width - dest_x,
+                  height = (int64_t) src->metadata.pixelarray_height - src_y < (int64_t) dest->metadata.pixelarray_height - dest_y ?
+                           (int64_t) src->metadata.pixelarray_height - src_y : (int64_t) dest->metadata.pixelarray_height - dest_y;
+
+    if (width <= 0 || height <= 0) return true;
+
+    for (int64_t n = 0; n < height; n++) {
+        memcpy(dest->pixelarray[dest_y + n] + dest_x, src->pixelarray[src_y + n] + src_x, width * sizeof(bbmp_Pixel));
+    }
+
     return true;
 }
 
@@ -325,38 +572,342 @@ uint8_t *bbmp_write_image(const bbmp_Image *location, uint8_t *raw_bmp_data) {
     
     if (!location || !raw_bmp_data) return NULL;
 
-    #define meta location->metadata
+    bbmp_write_header(&location->metadata, raw_bmp_data);
+
+    //convert the parsed pixelarray and save it to the offset to the start of the raw pixelarray in the raw bmp imge data
+    if (bbmp_convert_pixelarray(location->pixelarray, &(location->metadata), raw_bmp_data + location->metadata.pixelarray_off) == NULL) {
+        fprintf(stderr, "bbmp_helper: Error converting parsed pixelarray.");
+        return NULL;
+    }
+    
+    return raw_bmp_data;
+}
+
+static void bbmp_write_header(const bbmp_Metadata *meta, uint8_t *raw_bmp_data) {
+    /* 
+     * Write the bitmap file header and the DIB header described by "meta" to the first 54 bytes of "raw_bmp_data".
+    */
 
     //write the header to the raw_bmp_data
 
-    memcpy(raw_bmp_data + BSP_OFF_DIB_IDEN, meta.header_iden, 2);
-    * (uint32_t *) (raw_bmp_data + BSP_OFF_FILESIZE) = meta.filesize;
-    * (uint16_t *) (raw_bmp_data + BSP_OFF_RES1) = meta.res1;
-    * (uint16_t *) (raw_bmp_data + BSP_OFF_RES2) = meta.res2;
-    * (uint32_t *) (raw_bmp_data + BSP_OFF_PIXELARRAY_START) = meta.pixelarray_off;
+    memcpy(raw_bmp_data + BSP_OFF_DIB_IDEN, meta->header_iden, 2);
+    * (uint32_t *) (raw_bmp_data + BSP_OFF_FILESIZE) = meta->filesize;
+    * (uint16_t *) (raw_bmp_data + BSP_OFF_RES1) = meta->res1;
+    * (uint16_t *) (raw_bmp_data + BSP_OFF_RES2) = meta->res2;
+    * (uint32_t *) (raw_bmp_data + BSP_OFF_PIXELARRAY_START) = meta->pixelarray_off;
 
     // write the DIB (BITMAPINFOHEADER, 'BM') header to the raw_bmp_data
 
-    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_SIZE) = meta.dib_size;
-    * (int32_t *) (raw_bmp_data + BSP_OFF_DIB_IMGWIDTH) = meta.pixelarray_width;
-    * (int32_t *) (raw_bmp_data + BSP_OFF_DIB_IMGHEIGHT) = meta.pixelarray_height;
-    * (uint16_t *) (raw_bmp_data + BSP_OFF_DIB_PLANESNUM) = meta.panes_num;
-    * (uint16_t *) (raw_bmp_data + BSP_OFF_DIB_BPP) = meta.bpp;
-    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_COMPRESSION) = meta.compression_method;
-    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_IMGSIZE) = meta.pixelarray_size;
-    * (int32_t *) (raw_bmp_data + BSP_OFF_DIB_PPM_HORIZ) = meta.ppm_horiz;
-    * (int32_t *) (raw_bmp_data + BSP_OFF_DIB_PPM_VERT) = meta.ppm_vert;
-    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_COLORSNUM) = meta.colors_num;
-    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_IMPORTANTCOLORSNUM) = meta.colors_important_num;
+    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_SIZE) = meta->dib_size;
+    * (int32_t *) (raw_bmp_data + BSP_OFF_DIB_IMGWIDTH) = meta->pixelarray_width;
+    * (int32_t *) (raw_bmp_data + BSP_OFF_DIB_IMGHEIGHT) = meta->pixelarray_height;
+    * (uint16_t *) (raw_bmp_data + BSP_OFF_DIB_PLANESNUM) = meta->panes_num;
+    * (uint16_t *) (raw_bmp_data + BSP_OFF_DIB_BPP) = meta->bpp;
+    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_COMPRESSION) = meta->compression_method;
+    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_IMGSIZE) = meta->pixelarray_size;
+    * (int32_t *) (raw_bmp_data + BSP_OFF_DIB_PPM_HORIZ) = meta->ppm_horiz;
+    * (int32_t *) (raw_bmp_data + BSP_OFF_DIB_PPM_VERT) = meta->ppm_vert;
+    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_COLORSNUM) = meta->colors_num;
+    * (uint32_t *) (raw_bmp_data + BSP_OFF_DIB_IMPORTANTCOLORSNUM) = meta->colors_important_num;
+}
 
-    //convert the parsed pixelarray and save it to the offset to the start of the raw pixelarray in the raw bmp imge data
-    if (bbmp_convert_pixelarray(location->pixelarray, &(location->metadata), raw_bmp_data + meta.pixelarray_off) == NULL) {
-        fprintf(stderr, "bbmp_helper: Error converting parsed pixelarray.");
+bool bbmp_write_mosaic(FILE *stream, const bbmp_Image *const *tiles, size_t count, size_t columns, const bbmp_Pixel *fill) {
+    /* 
+     * Lay out "count" images pointed to by "tiles" on a grid with "columns" columns and write the resulting 24bpp BMP image to "stream".
+     * Every grid cell is as large as the largest tile. Tiles are placed left to right, top to bottom (as seen when viewing the image), 
+     * each aligned to the top-left corner of its cell. Cells not covered by a tile (and null entries in "tiles") are filled with the "fill" reference pixel.
+     * The output is streamed row by row, so the memory used is that of a single output row regardless of the size of the canvas.
+     * Returns true on success.
+    */
+
+    if (!stream || !tiles || !fill || !count || !columns) return false;
+
+    int32_t cell_width = 0,
+            cell_height = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!tiles[i]) continue;
+        if (tiles[i]->metadata.pixelarray_width > cell_width) cell_width = tiles[i]->metadata.pixelarray_width;
+        if (tiles[i]->metadata.pixelarray_height > cell_height) cell_height = tiles[i]->metadata.pixelarray_height;
+    }
+
+    if (!cell_width || !cell_height) return false;
+
+    // more columns than tiles would only add empty cells
+    if (columns > count) columns = count;
+
+    const size_t rows = (count + columns - 1) / columns;
+    const uint64_t canvas_width = (uint64_t) cell_width * columns,
+                   canvas_height = (uint64_t) cell_height * rows;
+
+    // the dimensions must fit the DIB header, and the pixelarray size (and with it the file size) its 32-bit fields
+    if (canvas_width > INT32_MAX || canvas_height > INT32_MAX) return false;
+    if ((canvas_width * 24 + 31) / 32 * 4 * canvas_height > UINT32_MAX - HEADER_BYTESIZE - BITMAPINFOHEADER_BYTESIZE) return false;
+
+    bbmp_Image canvas = {0};
+    bbmp_init_metadata(&canvas.metadata, canvas_width, canvas_height, 24);
+    bbmp_metaupdate(&canvas);
+
+    uint8_t header[HEADER_BYTESIZE + BITMAPINFOHEADER_BYTESIZE];
+    bbmp_write_header(&canvas.metadata, header);
+
+    if (fwrite(header, sizeof(header), 1u, stream) != 1) {
+        perror("bbmp_helper: Failed writing mosaic header: ");
+        return false;
+    }
+
+    // a single raw output row, padding bytes stay zeroed
+    uint8_t *row_raw = calloc(canvas.metadata.Bpr, 1);
+    if (!row_raw) {
+        perror("bbmp_helper: Failed allocating memory: ");
+        return false;
+    }
+
+    // a single row of an empty cell, pre-converted to raw bytes so that it can be copied with memcpy
+    uint8_t *cell_raw = malloc(cell_width * 3);
+    if (!cell_raw) {
+        perror("bbmp_helper: Failed allocating memory: ");
+        free(row_raw);
+        return false;
+    }
+
+    for (uint8_t *bp = cell_raw; bp < cell_raw + cell_width * 3; bp += 3) {
+        bp[0] = fill->b;
+        bp[1] = fill->g;
+        bp[2] = fill->r;
+    }
+
+    // BMP rows are stored bottom-up, so the first row written is the bottom row of the last grid row
+    for (int32_t y = 0; y < canvas.metadata.pixelarray_height; y++) {
+        const int32_t visual_row = canvas.metadata.pixelarray_height - 1 - y;
+        const size_t grid_row = visual_row / cell_height;
+        const int32_t cell_row = visual_row % cell_height;
+
+        for (size_t grid_col = 0; grid_col < columns; grid_col++) {
+            const size_t i = grid_row * columns + grid_col;
+            const bbmp_Image *tile = i < count ? tiles[i] : NULL;
+            uint8_t *bp_raw = row_raw + grid_col * cell_width * 3;
+            int32_t copied = 0;
+
+            if (tile && cell_row < tile->metadata.pixelarray_height) {
+                const bbmp_Pixel *src = tile->pixelarray[tile->metadata.pixelarray_height - 1 - cell_row];
+                copied = tile->metadata.pixelarray_width;
+
+                for (const bbmp_Pixel *bp = src; bp < src + copied; bp++) {
+                    bp_raw[0] = bp->b;
+                    bp_raw[1] = bp->g;
+                    bp_raw[2] = bp->r;
+
+                    bp_raw += 3;
+                }
+            }
+
+            memcpy(bp_raw, cell_raw, (cell_width - copied) * 3);
+        }
+
+        if (fwrite(row_raw, canvas.metadata.Bpr, 1u, stream) != 1) {
+            perror("bbmp_helper: Failed writing mosaic row: ");
+            free(row_raw);
+            free(cell_raw);
+            return false;
+        }
+    }
+
+    free(row_raw);
+    free(cell_raw);
+
+    return true;
+}
+
+bbmp_PlanarImage *bbmp_create_planar(int32_t width, int32_t height, bool alpha, bbmp_PlanarImage *location) {
+    /* 
+     * Create a blank planar image of the passed dimensions and save it to *location. If "alpha" is true, an alpha plane is allocated as well.
+     * All planes live in a single allocation, and every plane row starts at a BBMP_PLANE_ALIGNMENT aligned address. Plane memory is left uninitialized.
+     * The image must be freed with bbmp_destroy_planar(). Returns NULL on failure or the pointer to location on success.
+    */
+
+    if (!location || width <= 0 || height <= 0) return NULL;
+
+    const size_t stride = ((size_t) width + BBMP_PLANE_ALIGNMENT - 1) / BBMP_PLANE_ALIGNMENT * BBMP_PLANE_ALIGNMENT,
+                 plane_size = stride * height;
+
+    uint8_t *planes = aligned_alloc(BBMP_PLANE_ALIGNMENT, plane_size * (alpha ? 4 : 3));
+    if (!planes) {
+        perror("bbmp_helper: Failed allocating memory: ");
         return NULL;
     }
 
-    #undef meta
-    
+    *location = (bbmp_PlanarImage) {
+        .width = width,
+        .height = height,
+        .stride = stride,
+        .r = planes,
+        .g = planes + plane_size,
+        .b = planes + 2 * plane_size,
+        .a = alpha ? planes + 3 * plane_size : NULL
+    };
+
+    return location;
+}
+
+bool bbmp_destroy_planar(bbmp_PlanarImage *location) {
+    // free the planes of a planar image created by bbmp_create_planar(), the red plane holds the start of the allocation
+
+    if (!location) return false;
+
+    free(location->r);
+    *location = (bbmp_PlanarImage) {0};
+
+    return true;
+}
+
+/*
+ * The pixel step and channel offsets of the conversion loops below are compile-time constants: strided loads with a runtime step 
+ * become gathers, which the compiler doesn't vectorize, while constant ones become shuffles.
+*/
+
+static void bbmp_deinterleave_row_bgr(const uint8_t *restrict src, size_t n, uint8_t *restrict r, uint8_t *restrict g, uint8_t *restrict b) {
+    // split a row of n 24bpp BMP pixels (b, g, r) into three planes
+    for (size_t x = 0; x < n; x++) {
+        r[x] = src[x * 3 + 2];
+        g[x] = src[x * 3 + 1];
+        b[x] = src[x * 3];
+    }
+}
+
+static void bbmp_deinterleave_row_bgra(const uint8_t *restrict src, size_t n, uint8_t *restrict r, uint8_t *restrict g, uint8_t *restrict b, uint8_t *restrict a) {
+    // split a row of n 32bpp BMP pixels (b, g, r, a) into four planes
+    for (size_t x = 0; x < n; x++) {
+        r[x] = src[x * 4 + 2];
+        g[x] = src[x * 4 + 1];
+        b[x] = src[x * 4];
+        a[x] = src[x * 4 + 3];
+    }
+}
+
+bbmp_PlanarImage *bbmp_deinterleave(const bbmp_Image *img, bbmp_PlanarImage *location) {
+    /* 
+     * Convert the pixelarray of "img" to a newly created planar image (without an alpha plane) saved to *location.
+     * Returns NULL on failure or the pointer to location on success.
+    */
+
+    if (!img || !bbmp_create_planar(img->metadata.pixelarray_width, img->metadata.pixelarray_height, false, location)) return NULL;
+
+    const size_t width = location->width, height = location->height;
+
+    for (size_t n = 0; n < height; n++) {
+        const bbmp_Pixel *restrict row = img->pixelarray[n];
+        uint8_t *restrict r = location->r + n * location->stride,
+                *restrict g = location->g + n * location->stride,
+                *restrict b = location->b + n * location->stride;
+
+        for (size_t x = 0; x < width; x++) {
+            r[x] = row[x].r;
+            g[x] = row[x].g;
+            b[x] = row[x].b;
+        }
+    }
+
+    return location;
+}
+
+bbmp_Image *bbmp_interleave(const bbmp_PlanarImage *planar, bbmp_Image *location) {
+    /* 
+     * Convert the planar image "planar" to a newly created 24bpp bbmp_Image saved to *location. The alpha plane, if any, is dropped.
+     * Returns NULL on failure or the pointer to location on success.
+    */
+
+    if (!planar || !bbmp_create_image(planar->width, planar->height, 24, NULL, location)) return NULL;
+
+    const size_t width = planar->width, height = planar->height;
+
+    for (size_t n = 0; n < height; n++) {
+        const uint8_t *restrict r = planar->r + n * planar->stride,
+                      *restrict g = planar->g + n * planar->stride,
+                      *restrict b = planar->b + n * planar->stride;
+        bbmp_Pixel *restrict row = location->pixelarray[n];
+
+        for (size_t x = 0; x < width; x++) {
+            row[x].r = r[x];
+            row[x].g = g[x];
+            row[x].b = b[x];
+        }
+    }
+
+    return location;
+}
+
+bbmp_PlanarImage *bbmp_deinterleave_raw(const uint8_t *raw_bmp_data, bbmp_PlanarImage *location) {
+    /* 
+     * Convert the pixelarray of the raw BMP image (entire file data) pointed to by "raw_bmp_data" straight to a newly created planar image saved to *location,
+     * without parsing it into a bbmp_Image first. 24bpp and 32bpp images are supported; the latter get an alpha plane.
+     * Returns NULL on failure or the pointer to location on success.
+    */
+
+    if (!raw_bmp_data || !location) return NULL;
+
+    bbmp_Metadata meta;
+    bbmp_parse_bmp_metadata((unsigned char *) raw_bmp_data, &meta);
+
+    if ((meta.bpp != 24 && meta.bpp != 32) || !bbmp_create_planar(meta.pixelarray_width, meta.pixelarray_height, meta.bpp == 32, location)) return NULL;
+
+    const size_t width = location->width, height = location->height;
+
+    for (size_t n = 0; n < height; n++) {
+        const uint8_t *src = raw_bmp_data + meta.pixelarray_off + n * meta.Bpr;
+        const size_t off = n * location->stride;
+
+        if (location->a) bbmp_deinterleave_row_bgra(src, width, location->r + off, location->g + off, location->b + off, location->a + off);
+        else bbmp_deinterleave_row_bgr(src, width, location->r + off, location->g + off, location->b + off);
+    }
+
+    return location;
+}
+
+uint8_t *bbmp_interleave_raw(const bbmp_PlanarImage *planar, uint8_t *raw_bmp_data) {
+    /* 
+     * Write the planar image "planar" as a BMP image (entire file data) to "raw_bmp_data", which must be at least bbmp_planar_calc_bytesize(planar) bytes large.
+     * The image is written as 32bpp if "planar" has an alpha plane, and as 24bpp otherwise.
+     * Returns NULL on failure or the pointer to raw_bmp_data on success.
+    */
+
+    if (!planar || !raw_bmp_data) return NULL;
+
+    bbmp_Image header = {0};
+    bbmp_init_metadata(&header.metadata, planar->width, planar->height, planar->a ? 32 : 24);
+    bbmp_metaupdate(&header);
+    bbmp_write_header(&header.metadata, raw_bmp_data);
+
+    // the bytes stored below may alias *planar, so the loop bounds are loaded once up front, or the loops aren't vectorized
+    const size_t width = planar->width, height = planar->height;
+
+    for (size_t n = 0; n < height; n++) {
+        uint8_t *restrict dest = raw_bmp_data + header.metadata.pixelarray_off + n * header.metadata.Bpr;
+        const uint8_t *restrict r = planar->r + n * planar->stride,
+                      *restrict g = planar->g + n * planar->stride,
+                      *restrict b = planar->b + n * planar->stride;
+
+        if (planar->a) {
+            const uint8_t *restrict a = planar->a + n * planar->stride;
+
+            for (size_t x = 0; x < width; x++) {
+                dest[x * 4] = b[x];
+                dest[x * 4 + 1] = g[x];
+                dest[x * 4 + 2] = r[x];
+                dest[x * 4 + 3] = a[x];
+            }
+        } else {
+            for (size_t x = 0; x < width; x++) {
+                dest[x * 3] = b[x];
+                dest[x * 3 + 1] = g[x];
+                dest[x * 3 + 2] = r[x];
+            }
+        }
+
+        //append padding
+        memset(dest + header.metadata.Bpr_np, 0x0, header.metadata.padding);
+    }
+
     return raw_bmp_data;
 }
 
@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "bbmp_parallel.h"
+
+struct bbmp_ParallelTask {
+    bbmp_ParallelFn fn;
+    void *ctx;
+    size_t band, begin, end;
+}; typedef struct bbmp_ParallelTask bbmp_ParallelTask;
+
+static size_t parallel_threads = 1;
+static pthread_once_t parallel_threads_once = PTHREAD_ONCE_INIT;
+
+static void bbmp_parallel_init_threads(void) {
+    /* 
+     * Determine the number of threads available for parallel work, once per process. Defaults to the number of online processors, 
+     * and can be overridden with the BBMP_THREADS environment variable.
+    */
+
+    const char *env = getenv("BBMP_THREADS");
+    long threads = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (threads < 1) threads = 1;
+    if (threads > BBMP_PARALLEL_MAX_BANDS) threads = BBMP_PARALLEL_MAX_BANDS;
+
+    parallel_threads = threads;
+}
+
+static size_t bbmp_parallel_threads(void) {
+    pthread_once(&parallel_threads_once, bbmp_parallel_init_threads);
+
+    return parallel_threads;
+}
+
+static void *bbmp_parallel_worker(void *arg) {
+    bbmp_ParallelTask *task = arg;
+    task->fn(task->ctx, task->band, task->begin, task->end);
+
+    return NULL;
+}
+
+size_t bbmp_parallel_bands(size_t n, size_t grain) {
+    /* 
+     * Return the number of bands that bbmp_parallel_for() splits "n" items into. 
+     * Every band holds at least "grain" items, unless there is only a single band.
+     * The thread count is read only once per process, so the result never changes for the same "n" and "grain".
+    */
+
+    if (!grain) grain = 1;
+
+    size_t bands = n / grain,
+           threads = bbmp_parallel_threads();
+
+    if (bands > threads) bands = threads;
+    if (!bands) bands = 1;
+
+    return bands;
+}
+
+size_t bbmp_parallel_for(size_t n, size_t grain, bbmp_ParallelFn fn, void *ctx) {
+    /* 
+     * Split the range [0, n) into bbmp_parallel_bands(n, grain) contiguous bands of (nearly) equal size and call "fn" on each of them.
+     * The first band runs on the calling thread and the rest on newly created threads. If a thread can't be created its band is 
+     * run on the calling thread instead, so "fn" is always called exactly once per band. 
+     * Returns the number of bands used, after all of them have finished.
+    */
+
+    const size_t bands = bbmp_parallel_bands(n, grain);
+
+    if (bands == 1) {
+        fn(ctx, 0, 0, n);
+        return 1;
+    }
+
+    bbmp_ParallelTask tasks[BBMP_PARALLEL_MAX_BANDS];
+    pthread_t threads[BBMP_PARALLEL_MAX_BANDS];
+    bool spawned[BBMP_PARALLEL_MAX_BANDS] = {0};
+
+    for (size_t i = 0; i < bands; i++) {
+        tasks[i] = (bbmp_ParallelTask) {
+            .fn = fn,
+            .ctx = ctx,
+            .band = i,
+            .begin = n * i / bands,
+            .end = n * (i + 1) / bands
+        };
+    }
+
+    for (size_t i = 1; i < bands; i++) {
+        spawned[i] = pthread_create(&threads[i], NULL, bbmp_parallel_worker, &tasks[i]) == 0;
+    }
+
+    bbmp_parallel_worker(&tasks[0]);
+
+    for (size_t i = 1; i < bands; i++) {
+        if (spawned[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            bbmp_parallel_worker(&tasks[i]);
+        }
+    }
+
+    return bands;
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bbmp_parser.h"
+#include "bbmp_helper.h"
+#include "bbmp_qoi.h"
+
+/*
+ * QOI encoder and decoder working directly on the rows of a bbmp_PixelArray.
+ * QOI stores rows top-down while BMP stores them bottom-up, so rows are walked in reverse.
+*/
+
+#define QOI_OP_INDEX (0x00)
+#define QOI_OP_DIFF (0x40)
+#define QOI_OP_LUMA (0x80)
+#define QOI_OP_RUN (0xc0)
+#define QOI_OP_RGB (0xfe)
+#define QOI_OP_RGBA (0xff)
+#define QOI_MASK_2 (0xc0)
+#define QOI_MAGIC "qoif"
+
+// all channel arithmetic is done on the 32-bit r, g, b, a word so that pixels compare and copy as integers
+struct bbmp_QoiPixel {
+    uint8_t r, g, b, a;
+}; typedef struct bbmp_QoiPixel bbmp_QoiPixel;
+
+static inline size_t bbmp_qoi_hash(bbmp_QoiPixel px) {
+    return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+static inline bool bbmp_qoi_equal(bbmp_QoiPixel a, bbmp_QoiPixel b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static inline void bbmp_qoi_write32(uint8_t *bp, uint32_t v) {
+    bp[0] = v >> 24;
+    bp[1] = v >> 16;
+    bp[2] = v >> 8;
+    bp[3] = v;
+}
+
+static inline uint32_t bbmp_qoi_read32(const uint8_t *bp) {
+    return (uint32_t) bp[0] << 24 | (uint32_t) bp[1] << 16 | (uint32_t) bp[2] << 8 | bp[3];
+}
+
+size_t bbmp_qoi_encode(const bbmp_Image *img, uint8_t *buffer, size_t size) {
+    /* 
+     * Encode the pixelarray of "img" as a 3-channel sRGB QOI image and write it to "buffer", which is "size" bytes large.
+     * If "size" is at least bbmp_qoi_calc_bound(img), the encoding always fits; otherwise encoding fails as soon as a chunk doesn't fit,
+     * so a buffer of exactly the encoded size is enough.
+     * Returns the number of bytes written, or 0 on failure.
+    */
+
+    if (!img || !img->pixelarray || !buffer || img->metadata.pixelarray_width <= 0 || img->metadata.pixelarray_height <= 0) return 0;
+    if (size < BBMP_QOI_HEADER_BYTESIZE + BBMP_QOI_END_BYTESIZE) return 0;
+    if ((uint64_t) img->metadata.pixelarray_width * img->metadata.pixelarray_height > BBMP_QOI_MAX_PIXELS) return 0;
+
+    const size_t width = img->metadata.pixelarray_width;
+    /* 
+     * Every pixel takes at most 4 bytes (a pending run flush is paid for by the pixels of the run, which take none), so a buffer of 
+     * the worst-case size never needs checking. For smaller buffers, the room left before the end marker is checked before every chunk.
+    */
+    const bool checked = size < bbmp_qoi_calc_bound(img);
+    const uint8_t *end = buffer + size - BBMP_QOI_END_BYTESIZE;
+    uint8_t *bp = buffer;
+
+    memcpy(bp, QOI_MAGIC, 4);
+    bbmp_qoi_write32(bp + 4, img->metadata.pixelarray_width);
+    bbmp_qoi_write32(bp + 8, img->metadata.pixelarray_height);
+    bp[12] = 3; //channels
+    bp[13] = 0; //sRGB with linear alpha
+    bp += BBMP_QOI_HEADER_BYTESIZE;
+
+    bbmp_QoiPixel index[64] = {{0}},
+                  prev = {.a = 255};
+    size_t run = 0;
+
+    for (bbmp_PixelArray row = img->pixelarray + img->metadata.pixelarray_height - 1; row >= img->pixelarray; row--) {
+        const bbmp_Pixel *restrict pixels = *row;
+
+        for (size_t x = 0; x < width; x++) {
+            const bbmp_QoiPixel px = {.r = pixels[x].r, .g = pixels[x].g, .b = pixels[x].b, .a = 255};
+
+            if (bbmp_qoi_equal(px, prev)) {
+                if (++run == 62) {
+                    if (checked && end - bp < 1) return 0;
+                    *bp++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run) {
+                if (checked && end - bp < 1) return 0;
+                *bp++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            const size_t hash = bbmp_qoi_hash(px);
+
+            if (bbmp_qoi_equal(index[hash], px)) {
+                if (checked && end - bp < 1) return 0;
+                *bp++ = QOI_OP_INDEX | hash;
+            } else {
+                index[hash] = px;
+
+                const int8_t vr = px.r - prev.r,
+                             vg = px.g - prev.g,
+                             vb = px.b - prev.b,
+                             vg_r = vr - vg,
+                             vg_b = vb - vg;
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    if (checked && end - bp < 1) return 0;
+                    *bp++ = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                    if (checked && end - bp < 2) return 0;
+                    *bp++ = QOI_OP_LUMA | (vg + 32);
+                    *bp++ = (vg_r + 8) << 4 | (vg_b + 8);
+                } else {
+                    if (checked && end - bp < 4) return 0;
+                    *bp++ = QOI_OP_RGB;
+                    *bp++ = px.r;
+                    *bp++ = px.g;
+                    *bp++ = px.b;
+                }
+            }
+
+            prev = px;
+        }
+    }
+
+    if (run) {
+        if (checked && end - bp < 1) return 0;
+        *bp++ = QOI_OP_RUN | (run - 1);
+    }
+
+    memset(bp, 0, BBMP_QOI_END_BYTESIZE - 1);
+    bp[BBMP_QOI_END_BYTESIZE - 1] = 1;
+    bp += BBMP_QOI_END_BYTESIZE;
+
+    return bp - buffer;
+}
+
+bbmp_Image *bbmp_qoi_decode(const uint8_t *data, size_t size, bbmp_Image *location) {
+    /* 
+     * Decode the "size" bytes of QOI image data pointed to by "data" into a newly created 24bpp image saved to *location.
+     * Truncated or corrupt data never causes reads out of bounds; it makes the function fail instead.
+     * The new image must be freed with bbmp_destroy_image(). Returns NULL on failure or the pointer to location on success.
+    */
+
+    if (!data || !location || size < BBMP_QOI_HEADER_BYTESIZE + BBMP_QOI_END_BYTESIZE || memcmp(data, QOI_MAGIC, 4)) return NULL;
+
+    const uint32_t width = bbmp_qoi_read32(data + 4),
+                   height = bbmp_qoi_read32(data + 8);
+
+    if (!width || !height || (uint64_t) width * height > BBMP_QOI_MAX_PIXELS || (data[12] != 3 && data[12] != 4)) return NULL;
+    // every chunk yields at most 62 pixels (a full run), so data too short to hold them all is rejected before allocating the image
+    if ((uint64_t) width * height > (uint64_t) (size - BBMP_QOI_HEADER_BYTESIZE - BBMP_QOI_END_BYTESIZE) * 62) return NULL;
+
+    if (!bbmp_create_image(width, height, 24, NULL, location)) return NULL;
+
+    // chunks never start within the end marker
+    const uint8_t *bp = data + BBMP_QOI_HEADER_BYTESIZE,
+                  *end = data + size - BBMP_QOI_END_BYTESIZE;
+
+    bbmp_QoiPixel index[64] = {{0}},
+                  px = {.a = 255};
+    size_t run = 0;
+
+    for (bbmp_PixelArray row = location->pixelarray + height - 1; row >= location->pixelarray; row--) {
+        bbmp_Pixel *restrict pixels = *row;
+
+        for (size_t x = 0; x < width; x++) {
+            if (run) {
+                run--;
+            } else {
+                if (bp >= end) goto corrupt;
+
+                const uint8_t b1 = *bp++;
+
+                if (b1 == QOI_OP_RGB) {
+                    if (end - bp < 3) goto corrupt;
+                    px.r = bp[0];
+                    px.g = bp[1];
+                    px.b = bp[2];
+                    bp += 3;
+                } else if (b1 == QOI_OP_RGBA) {
+                    if (end - bp < 4) goto corrupt;
+                    px.r = bp[0];
+                    px.g = bp[1];
+                    px.b = bp[2];
+                    px.a = bp[3];
+                    bp += 4;
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                    px = index[b1];
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                    px.r += ((b1 >> 4) & 0x03) - 2;
+                    px.g += ((b1 >> 2) & 0x03) - 2;
+                    px.b += (b1 & 0x03) - 2;
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                    if (bp >= end) goto corrupt;
+                    const uint8_t b2 = *bp++;
+                    const int vg = (b1 & 0x3f) - 32;
+                    px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                    px.g += vg;
+                    px.b += vg - 8 + (b2 & 0x0f);
+                } else {
+                    run = b1 & 0x3f;
+                }
+
+                index[bbmp_qoi_hash(px)] = px;
+            }
+
+            pixels[x] = (bbmp_Pixel) {.r = px.r, .g = px.g, .b = px.b};
+        }
+    }
+
+    return location;
+
+corrupt:
+    fprintf(stderr, "bbmp_qoi: Truncated or corrupt QOI data\n");
+    bbmp_destroy_image(location);
+    return NULL;
+}
@@ -1,7 +1,15 @@
 #include "bbmp_helper.h"
 #include "bbmp_parser.h"
+#include "bbmp_parallel.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+
+#define BBMP_USERSPACE_GRAIN (64) //minimum number of rows per band for the functions that run in parallel
+#define BBMP_WARP_TILE (64) //side of the square destination tiles bbmp_warp_affine works through, in pixels
+#define BBMP_WARP_FRAC (16) //number of fractional bits of the fixed point source coordinates
+#define BBMP_WARP_MAX_COORD ((INT32_MAX >> BBMP_WARP_FRAC) - 1) //largest magnitude of a source coordinate, so that the 32-bit fixed point coordinates never overflow
 
 
 bbmp_Image *bbmp_grayscale(bbmp_Image *image) {
@@ -10,7 +18,7 @@ bbmp_Image *bbmp_grayscale(bbmp_Image *image) {
      * Returns NULL on failure or the pointer to the bbmp_Image on success.
     */
 
-    if(!image) return NULL;
+    if(!image || !bbmp_make_unique(image)) return NULL;
 
     for(size_t n = 0; n < image->metadata.pixelarray_height; n++) {
         for(size_t m = 0; m < image->metadata.pixelarray_width; m++) {
@@ -28,7 +36,300 @@ bbmp_Image *bbmp_grayscale(bbmp_Image *image) {
     return image;
 }
 
+bbmp_PlanarImage *bbmp_grayscale_planar(bbmp_PlanarImage *image) {
+    /*
+     * Same as bbmp_grayscale, but for a planar image. The luma is calculated in 16-bit fixed point (the weights sum up to 1 exactly), 
+     * so the whole row is processed at full vector width. The result can differ from bbmp_grayscale by one level at most. The alpha plane is left untouched.
+     * Returns NULL on failure or the pointer to the bbmp_PlanarImage on success.
+    */
+
+    if (!image) return NULL;
+
+    // the bytes stored below may alias *image, so the loop bounds are loaded once up front, or the inner loop isn't vectorized
+    const size_t width = image->width, height = image->height, stride = image->stride;
+
+    for (size_t n = 0; n < height; n++) {
+        uint8_t *restrict r = image->r + n * stride,
+                *restrict g = image->g + n * stride,
+                *restrict b = image->b + n * stride;
+
+        for (size_t x = 0; x < width; x++) {
+            const uint8_t full = (19595u * r[x] + 38470u * g[x] + 7471u * b[x]) >> 16;
+
+            r[x] = full;
+            g[x] = full;
+            b[x] = full;
+        }
+    }
+
+    return image;
+}
+
+struct bbmp_HistogramCtx {
+    bbmp_ImageRef image;
+    bbmp_Histogram *bands; //one histogram per band, merged once all bands finish
+}; typedef struct bbmp_HistogramCtx bbmp_HistogramCtx;
+
+static void bbmp_histogram_band(void *arg, size_t band, size_t begin, size_t end) {
+    bbmp_HistogramCtx *ctx = arg;
+    uint32_t (*hist)[256] = ctx->bands[band].channel;
+
+    for (size_t n = begin; n < end; n++) {
+        if (ctx->image.layout == BBMP_LAYOUT_PLANAR) {
+            const bbmp_PlanarImage *img = ctx->image.planar;
+            const uint8_t *planes[3] = {img->r + n * img->stride, img->g + n * img->stride, img->b + n * img->stride};
+
+            // one channel at a time, so every pass only touches a single plane row and a single table
+            for (size_t c = 0; c < 3; c++) {
+                for (size_t x = 0; x < (size_t) img->width; x++) {
+                    hist[c][planes[c][x]]++;
+                }
+            }
+        } else {
+            const bbmp_Pixel *row = ctx->image.packed->pixelarray[n];
+
+            for (size_t x = 0; x < (size_t) ctx->image.packed->metadata.pixelarray_width; x++) {
+                hist[0][row[x].r]++;
+                hist[1][row[x].g]++;
+                hist[2][row[x].b]++;
+            }
+        }
+    }
+}
+
+static size_t bbmp_ref_height(bbmp_ImageRef image) {
+    return image.layout == BBMP_LAYOUT_PLANAR ? image.planar->height : image.packed->metadata.pixelarray_height;
+}
+
+static bool bbmp_ref_valid(bbmp_ImageRef image) {
+    return (image.layout == BBMP_LAYOUT_PLANAR && image.planar) || (image.layout == BBMP_LAYOUT_PACKED && image.packed);
+}
+
+bool bbmp_histogram(bbmp_ImageRef image, bbmp_Histogram *histogram) {
+    /*
+     * Count the occurences of every value of every color channel of the image (in either layout) and save them to *histogram.
+     * Rows are counted in parallel.
+     * Returns true on success.
+    */
+
+    if (!bbmp_ref_valid(image) || !histogram) return false;
+
+    const size_t height = bbmp_ref_height(image);
+
+    // the thread count is fixed per process, so bbmp_parallel_for() uses exactly this many bands
+    bbmp_HistogramCtx ctx = {.image = image, .bands = calloc(bbmp_parallel_bands(height, BBMP_USERSPACE_GRAIN), sizeof(*ctx.bands))};
+    if (!ctx.bands) {
+        perror("bbmp_userspace: Failed allocating memory: ");
+        return false;
+    }
+
+    const size_t bands = bbmp_parallel_for(height, BBMP_USERSPACE_GRAIN, bbmp_histogram_band, &ctx);
+
+    memset(histogram, 0, sizeof(bbmp_Histogram));
+    for (size_t i = 0; i < bands; i++) {
+        for (size_t c = 0; c < 3; c++) {
+            for (size_t v = 0; v < 256; v++) {
+                histogram->channel[c][v] += ctx.bands[i].channel[c][v];
+            }
+        }
+    }
+
+    free(ctx.bands);
+
+    return true;
+}
+
+struct bbmp_LutCtx {
+    bbmp_ImageRef image;
+    const bbmp_Lut *lut;
+}; typedef struct bbmp_LutCtx bbmp_LutCtx;
+
+static void bbmp_apply_lut_band(void *arg, size_t band, size_t begin, size_t end) {
+    bbmp_LutCtx *ctx = arg;
+    const uint8_t *restrict lr = ctx->lut->channel[0],
+                  *restrict lg = ctx->lut->channel[1],
+                  *restrict lb = ctx->lut->channel[2];
+
+    for (size_t n = begin; n < end; n++) {
+        if (ctx->image.layout == BBMP_LAYOUT_PLANAR) {
+            const bbmp_PlanarImage *img = ctx->image.planar;
+            const size_t width = img->width; //hoisted, see bbmp_grayscale_planar
+            uint8_t *restrict r = img->r + n * img->stride,
+                    *restrict g = img->g + n * img->stride,
+                    *restrict b = img->b + n * img->stride;
+
+            for (size_t x = 0; x < width; x++) r[x] = lr[r[x]];
+            for (size_t x = 0; x < width; x++) g[x] = lg[g[x]];
+            for (size_t x = 0; x < width; x++) b[x] = lb[b[x]];
+        } else {
+            bbmp_Pixel *restrict row = ctx->image.packed->pixelarray[n];
+
+            for (size_t x = 0; x < (size_t) ctx->image.packed->metadata.pixelarray_width; x++) {
+                row[x].r = lr[row[x].r];
+                row[x].g = lg[row[x].g];
+                row[x].b = lb[row[x].b];
+            }
+        }
+    }
+}
+
+bool bbmp_apply_lut(bbmp_ImageRef image, const bbmp_Lut *lut) {
+    /*
+     * Replace every color channel value of the image (in either layout) with lut->channel[channel][value]. 
+     * Rows are processed in parallel. The alpha plane of planar images is left untouched.
+     * Returns true on success.
+    */
+
+    if (!bbmp_ref_valid(image) || !lut) return false;
+    if (image.layout == BBMP_LAYOUT_PACKED && !bbmp_make_unique(image.packed)) return false;
+
+    bbmp_LutCtx ctx = {.image = image, .lut = lut};
+    bbmp_parallel_for(bbmp_ref_height(image), BBMP_USERSPACE_GRAIN, bbmp_apply_lut_band, &ctx);
+
+    return true;
+}
+
+/*
+ * Point operation engine: every bbmp_lut_* function below composes a per-channel transform into an existing bbmp_Lut (after the transforms 
+ * already in it), so any number of chained adjustments is applied by a single bbmp_apply_lut() pass costing one table lookup per channel.
+ * The floating point math is only evaluated 256 times per channel, when the transform is composed.
+*/
+
+static uint8_t bbmp_clamp(double v) {
+    return v <= 0 ? 0 : v >= 255 ? 255 : (uint8_t) (v + 0.5);
+}
+
+static bbmp_Lut *bbmp_lut_compose(bbmp_Lut *lut, unsigned channels, const uint8_t f[256]) {
+    // replace every table entry selected by "channels" with f[entry], so that f is applied after the transforms already in the table
+
+    if (!lut) return NULL;
+
+    for (size_t c = 0; c < 3; c++) {
+        if (!(channels & (1u << c))) continue;
+
+        for (size_t v = 0; v < 256; v++) {
+            lut->channel[c][v] = f[lut->channel[c][v]];
+        }
+    }
+
+    return lut;
+}
+
+bbmp_Lut *bbmp_lut_identity(bbmp_Lut *lut) {
+    // initialize every table of "lut" to the identity transform, the starting point for composing point operations
+
+    if (!lut) return NULL;
+
+    for (size_t c = 0; c < 3; c++) {
+        for (size_t v = 0; v < 256; v++) {
+            lut->channel[c][v] = v;
+        }
+    }
+
+    return lut;
+}
+
+bbmp_Lut *bbmp_lut_gamma(bbmp_Lut *lut, unsigned channels, double gamma) {
+    // compose gamma correction (v' = 255 * (v / 255) ^ (1 / gamma)) into the selected channels; gamma > 1 brightens midtones
+
+    if (!(gamma > 0)) return NULL;
+
+    uint8_t f[256];
+    for (size_t v = 0; v < 256; v++) f[v] = bbmp_clamp(255 * pow(v / 255.0, 1 / gamma));
+
+    return bbmp_lut_compose(lut, channels, f);
+}
+
+bbmp_Lut *bbmp_lut_brightness(bbmp_Lut *lut, unsigned channels, int delta) {
+    // compose a brightness adjustment (v' = v + delta, clamped) into the selected channels
+
+    uint8_t f[256];
+    for (size_t v = 0; v < 256; v++) f[v] = bbmp_clamp((double) v + delta);
+
+    return bbmp_lut_compose(lut, channels, f);
+}
+
+bbmp_Lut *bbmp_lut_contrast(bbmp_Lut *lut, unsigned channels, double factor) {
+    // compose a contrast adjustment around mid-gray (v' = (v - 128) * factor + 128, clamped) into the selected channels
+
+    if (!(factor >= 0)) return NULL;
+
+    uint8_t f[256];
+    for (size_t v = 0; v < 256; v++) f[v] = bbmp_clamp(((double) v - 128) * factor + 128);
+
+    return bbmp_lut_compose(lut, channels, f);
+}
+
+bbmp_Lut *bbmp_lut_levels(bbmp_Lut *lut, unsigned channels, uint8_t in_black, uint8_t in_white, double gamma, uint8_t out_black, uint8_t out_white) {
+    /*
+     * Compose a levels adjustment into the selected channels: the input range [in_black, in_white] is stretched to [0, 1] (clipping values outside of it), 
+     * gamma corrected like in bbmp_lut_gamma and then mapped to the output range [out_black, out_white].
+     * Returns NULL if in_black isn't lower than in_white or gamma isn't positive.
+    */
+
+    if (in_black >= in_white || !(gamma > 0)) return NULL;
+
+    uint8_t f[256];
+    for (size_t v = 0; v < 256; v++) {
+        double t = ((double) v - in_black) / (in_white - in_black);
+        t = t < 0 ? 0 : t > 1 ? 1 : t;
+
+        f[v] = bbmp_clamp(out_black + pow(t, 1 / gamma) * ((double) out_white - out_black));
+    }
+
+    return bbmp_lut_compose(lut, channels, f);
+}
+
+bbmp_Lut *bbmp_lut_invert(bbmp_Lut *lut, unsigned channels) {
+    // compose inversion (v' = 255 - v) into the selected channels
+
+    uint8_t f[256];
+    for (size_t v = 0; v < 256; v++) f[v] = 255 - v;
+
+    return bbmp_lut_compose(lut, channels, f);
+}
+
+bbmp_Lut *bbmp_lut_equalize(bbmp_Lut *lut, unsigned channels, const bbmp_Histogram *histogram) {
+    /*
+     * Compose histogram equalization into the selected channels. "histogram" must be the histogram of the image the table is going to be applied to 
+     * (see bbmp_histogram), taken before any of the transforms already in the table; it is run through those first, so that the equalization is 
+     * computed for the values it will actually see. Every channel is equalized independently.
+    */
+
+    if (!lut || !histogram) return NULL;
+
+    for (size_t c = 0; c < 3; c++) {
+        if (!(channels & (1u << c))) continue;
+
+        uint64_t hist[256] = {0},
+                 cdf = 0,
+                 cdf_min = 0,
+                 total = 0;
+
+        for (size_t v = 0; v < 256; v++) {
+            hist[lut->channel[c][v]] += histogram->channel[c][v];
+            total += histogram->channel[c][v];
+        }
+
+        for (size_t v = 0; v < 256 && !cdf_min; v++) cdf_min = hist[v];
+
+        // an empty or single-valued channel has nothing to spread out
+        if (total == cdf_min) continue;
+
+        uint8_t f[256];
+        for (size_t v = 0; v < 256; v++) {
+            cdf += hist[v];
+            f[v] = cdf <= cdf_min ? 0 : bbmp_clamp((double) (cdf - cdf_min) * 255 / (total - cdf_min));
+        }
+
+        bbmp_lut_compose(lut, 1u << c, f);
+    }
+
+    return lut;
+}
+
 bbmp_Image *bbmp_vertflip(bbmp_Image *image) {
+    // only the row pointers of this image are swapped, so pixel storage shared with views stays shared
     if(!image) return NULL;
 
     bbmp_Pixel **start = image->pixelarray,
@@ -52,10 +353,15 @@ bbmp_Image *bbmp_rot90(bbmp_Image *image, const enum clock_dir direction) {
      * Returns NULL on failure or the pointer to the bbmp_Image on success.
     */
 
-    if (image->metadata.pixelarray_width != image->metadata.pixelarray_height || (direction != CW && direction != CCW)) return NULL;
+    if (!image || image->metadata.pixelarray_width != image->metadata.pixelarray_height || (direction != CW && direction != CCW)) return NULL;
 
     const size_t r = image->metadata.pixelarray_width;
 
+    // a single pixel (or an empty image) is its own rotation
+    if (r < 2) return image;
+
+    if (!bbmp_make_unique(image)) return NULL;
+
     // in-place transposition
     for(size_t n = 0; n <= r - 2; n++) {
         for(size_t m = n + 1; m <= r - 1; m++) {
@@ -104,3 +410,202 @@ bbmp_Image *bbmp_rot90(bbmp_Image *image, const enum clock_dir direction) {
 
     return image;
 }
+
+bbmp_Affine *bbmp_affine_rotation(bbmp_Affine *affine, double degrees, double cx, double cy) {
+    /* 
+     * Save a transformation rotating by "degrees" counter-clockwise (as seen when viewing the image) around the point (cx, cy) to *affine.
+     * Returns NULL on failure or the pointer to affine on success.
+    */
+
+    if (!affine) return NULL;
+
+    const double rad = degrees * 3.14159265358979323846 / 180,
+                 c = cos(rad),
+                 s = sin(rad);
+
+    // the y axis of a pixelarray points up, so this is the usual counter-clockwise rotation matrix
+    *affine = (bbmp_Affine) {.m = {
+        {c, -s, cx - c * cx + s * cy},
+        {s, c, cy - s * cx - c * cy}
+    }};
+
+    return affine;
+}
+
+struct bbmp_WarpCtx {
+    const bbmp_Image *src;
+    bbmp_Image *dest;
+    double inv[2][3]; //inverse of the transformation, mapping destination coordinates to source coordinates
+    bbmp_Pixel fill;
+    enum bbmp_Sampling sampling;
+    size_t tile_cols;
+}; typedef struct bbmp_WarpCtx bbmp_WarpCtx;
+
+static inline int32_t bbmp_fixed_floor(int32_t v) {
+    // integer part of a fixed point value, rounding towards negative infinity without relying on the right shift of negative values
+    return v >= 0 ? v >> BBMP_WARP_FRAC : -((-v + (1 << BBMP_WARP_FRAC) - 1) >> BBMP_WARP_FRAC);
+}
+
+static inline bbmp_Pixel bbmp_warp_fetch(const bbmp_WarpCtx *ctx, int32_t x, int32_t y) {
+    if (x < 0 || y < 0 || x >= ctx->src->metadata.pixelarray_width || y >= ctx->src->metadata.pixelarray_height) return ctx->fill;
+
+    return ctx->src->pixelarray[y][x];
+}
+
+static void bbmp_warp_band(void *arg, size_t band, size_t begin, size_t end) {
+    /* 
+     * Handle destination tile rows [begin, end). Within every tile, the source coordinates of a row are computed once in floating point
+     * at its start and then advanced by a constant fixed point step per pixel. The coordinates are 32-bit, so that the stepping loop is 
+     * vectorized (there is no 64-bit vector multiply on baseline x86-64); bbmp_warp_affine() makes sure they fit.
+    */
+
+    bbmp_WarpCtx *ctx = arg;
+    const int32_t src_w = ctx->src->metadata.pixelarray_width,
+                  src_h = ctx->src->metadata.pixelarray_height,
+                  dest_w = ctx->dest->metadata.pixelarray_width,
+                  dest_h = ctx->dest->metadata.pixelarray_height;
+
+    const double one = 1 << BBMP_WARP_FRAC;
+    const int32_t step_x = lround(ctx->inv[0][0] * one),
+                  step_y = lround(ctx->inv[1][0] * one);
+
+    int32_t xs[BBMP_WARP_TILE], ys[BBMP_WARP_TILE];
+
+    for (size_t tile_row = begin; tile_row < end; tile_row++) {
+        const int32_t v_start = tile_row * BBMP_WARP_TILE,
+                      v_end = v_start + BBMP_WARP_TILE < dest_h ? v_start + BBMP_WARP_TILE : dest_h;
+
+        for (size_t tile_col = 0; tile_col < ctx->tile_cols; tile_col++) {
+            const int32_t u_start = tile_col * BBMP_WARP_TILE,
+                          u_end = u_start + BBMP_WARP_TILE < dest_w ? u_start + BBMP_WARP_TILE : dest_w,
+                          n = u_end - u_start;
+
+            for (int32_t v = v_start; v < v_end; v++) {
+                bbmp_Pixel *restrict out = ctx->dest->pixelarray[v] + u_start;
+
+                int32_t x = lround((ctx->inv[0][0] * u_start + ctx->inv[0][1] * v + ctx->inv[0][2]) * one),
+                        y = lround((ctx->inv[1][0] * u_start + ctx->inv[1][1] * v + ctx->inv[1][2]) * one);
+
+                /* 
+                 * Coordinates of the whole tile row first, in a loop simple enough to be vectorized. Every partial sum is the coordinate 
+                 * of a pixel up to and including u_end, all of which bbmp_warp_affine() checked, so none of them overflows.
+                */
+                for (int32_t i = 0; i < n; i++) {
+                    xs[i] = x;
+                    ys[i] = y;
+                    x += step_x;
+                    y += step_y;
+                }
+
+                if (ctx->sampling == BBMP_SAMPLE_NEAREST) {
+                    for (int32_t i = 0; i < n; i++) {
+                        out[i] = bbmp_warp_fetch(ctx, bbmp_fixed_floor(xs[i] + (1 << (BBMP_WARP_FRAC - 1))), bbmp_fixed_floor(ys[i] + (1 << (BBMP_WARP_FRAC - 1))));
+                    }
+                    continue;
+                }
+
+                for (int32_t i = 0; i < n; i++) {
+                    const int32_t sx = bbmp_fixed_floor(xs[i]),
+                                  sy = bbmp_fixed_floor(ys[i]);
+                    // 8-bit interpolation weights
+                    const uint32_t fx = (xs[i] - sx * (1 << BBMP_WARP_FRAC)) >> (BBMP_WARP_FRAC - 8),
+                                   fy = (ys[i] - sy * (1 << BBMP_WARP_FRAC)) >> (BBMP_WARP_FRAC - 8);
+
+                    bbmp_Pixel p00, p01, p10, p11;
+
+                    if (sx >= 0 && sy >= 0 && sx < src_w - 1 && sy < src_h - 1) {
+                        // fast path, all four neighbours lie within the source
+                        const bbmp_Pixel *row0 = ctx->src->pixelarray[sy] + sx,
+                                         *row1 = ctx->src->pixelarray[sy + 1] + sx;
+                        p00 = row0[0];
+                        p01 = row0[1];
+                        p10 = row1[0];
+                        p11 = row1[1];
+                    } else if (sx < -1 || sy < -1 || sx >= src_w || sy >= src_h) {
+                        out[i] = ctx->fill;
+                        continue;
+                    } else {
+                        // on the border, the neighbours outside of the source are blended with the fill pixel
+                        p00 = bbmp_warp_fetch(ctx, sx, sy);
+                        p01 = bbmp_warp_fetch(ctx, sx + 1, sy);
+                        p10 = bbmp_warp_fetch(ctx, sx, sy + 1);
+                        p11 = bbmp_warp_fetch(ctx, sx + 1, sy + 1);
+                    }
+
+                    const uint32_t w00 = (256 - fx) * (256 - fy),
+                                   w01 = fx * (256 - fy),
+                                   w10 = (256 - fx) * fy,
+                                   w11 = fx * fy;
+
+                    out[i] = (bbmp_Pixel) {
+                        .r = (p00.r * w00 + p01.r * w01 + p10.r * w10 + p11.r * w11 + (1 << 15)) >> 16,
+                        .g = (p00.g * w00 + p01.g * w01 + p10.g * w10 + p11.g * w11 + (1 << 15)) >> 16,
+                        .b = (p00.b * w00 + p01.b * w01 + p10.b * w10 + p11.b * w11 + (1 << 15)) >> 16
+                    };
+                }
+            }
+        }
+    }
+}
+
+bbmp_Image *bbmp_warp_affine(const bbmp_Image *src, const bbmp_Affine *affine, int32_t width, int32_t height, const bbmp_Pixel *fill, enum bbmp_Sampling sampling, bbmp_Image *location) {
+    /* 
+     * Transform "src" by the affine transformation "affine" into a newly created "width" x "height" 24bpp image saved to *location.
+     * Every destination pixel is mapped back into "src" and sampled there using nearest neighbour or bilinear sampling; 
+     * destination pixels that map outside of "src" are set to the "fill" reference pixel.
+     * The destination is processed in square tiles for cache locality, with rows of tiles split between threads.
+     * Transformations mapping any destination pixel further than BBMP_WARP_MAX_COORD (32766) pixels away from the source origin are rejected.
+     * The new image must be freed with bbmp_destroy_image(). Returns NULL on failure (including a non-invertible transformation) or the pointer to location on success.
+    */
+
+    if (!src || !src->pixelarray || !affine || !fill || !location || src == location || width <= 0 || height <= 0) return NULL;
+    if (sampling != BBMP_SAMPLE_NEAREST && sampling != BBMP_SAMPLE_BILINEAR) return NULL;
+
+    const double (*m)[3] = affine->m,
+                 det = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+
+    if (det == 0 || !isfinite(det)) return NULL;
+
+    bbmp_WarpCtx ctx = {
+        .src = src,
+        .dest = location,
+        .inv = {
+            {m[1][1] / det, -m[0][1] / det, (m[0][1] * m[1][2] - m[1][1] * m[0][2]) / det},
+            {-m[1][0] / det, m[0][0] / det, (m[1][0] * m[0][2] - m[0][0] * m[1][2]) / det}
+        },
+        .fill = *fill,
+        .sampling = sampling,
+        .tile_cols = (width + BBMP_WARP_TILE - 1) / BBMP_WARP_TILE
+    };
+
+    // the mapping is affine, so the source coordinates are extreme at the corners (one past the last pixel, where bbmp_warp_band stops stepping)
+    for (int corner = 0; corner < 4; corner++) {
+        const double u = corner & 1 ? width : 0,
+                     v = corner & 2 ? height : 0;
+
+        if (!(fabs(ctx.inv[0][0] * u + ctx.inv[0][1] * v + ctx.inv[0][2]) <= BBMP_WARP_MAX_COORD) ||
+            !(fabs(ctx.inv[1][0] * u + ctx.inv[1][1] * v + ctx.inv[1][2]) <= BBMP_WARP_MAX_COORD)) {
+            return NULL;
+        }
+    }
+
+    if (!bbmp_create_image(width, height, 24, NULL, location)) return NULL;
+
+    bbmp_parallel_for((height + BBMP_WARP_TILE - 1) / BBMP_WARP_TILE, 1, bbmp_warp_band, &ctx);
+
+    return location;
+}
+
+bbmp_Image *bbmp_rotate(const bbmp_Image *src, double degrees, const bbmp_Pixel *fill, enum bbmp_Sampling sampling, bbmp_Image *location) {
+    /* 
+     * Rotate "src" by an arbitrary angle of "degrees" counter-clockwise around its center into a newly created image of the same dimensions, saved to *location.
+     * Corners rotated out of the canvas are cut off and uncovered areas are set to the "fill" reference pixel. See bbmp_warp_affine().
+    */
+
+    if (!src) return NULL;
+
+    bbmp_Affine affine;
+    bbmp_affine_rotation(&affine, degrees, (src->metadata.pixelarray_width - 1) / 2.0, (src->metadata.pixelarray_height - 1) / 2.0);
+
+    return bbmp_warp_affine(src, &affine, src->metadata.pixelarray_width, src->metadata.pixelarray_height, fill, sampling, location);
+}
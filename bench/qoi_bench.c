@@ -0,0 +1,107 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "bbmp_helper.h"
+#include "bbmp_qoi.h"
+
+/*
+ * Compare QOI and BMP round-trips (encode to a memory buffer, then decode back into a bbmp_Image) at several resolutions.
+ * The test image is a smooth gradient with a noisy band, roughly what intermediate artifacts of an image pipeline look like.
+ * Usage: bbmp_qoi_bench [iterations]
+*/
+
+static const int32_t resolutions[][2] = {{256, 256}, {1024, 768}, {1920, 1080}, {3840, 2160}};
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_fill(bbmp_Image *img) {
+    uint32_t seed = 0x9e3779b9;
+
+    for (int32_t y = 0; y < img->metadata.pixelarray_height; y++) {
+        for (int32_t x = 0; x < img->metadata.pixelarray_width; x++) {
+            bbmp_Pixel px = {.r = x * 255 / img->metadata.pixelarray_width, .g = y * 255 / img->metadata.pixelarray_height, .b = 128};
+
+            if (y % 256 < 32) {
+                seed = seed * 1664525 + 1013904223;
+                px.b = seed >> 24;
+            }
+
+            img->pixelarray[y][x] = px;
+        }
+    }
+}
+
+signed int main(int argc, char **argv) {
+    const long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 10;
+    if (iterations < 1) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-11s %-4s %12s %10s %12s %12s\n", "resolution", "fmt", "bytes", "ratio", "encode MB/s", "decode MB/s");
+
+    for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+        bbmp_Image img;
+        if (!bbmp_create_image(resolutions[r][0], resolutions[r][1], 24, NULL, &img)) return EXIT_FAILURE;
+        bench_fill(&img);
+
+        const double pixel_mb = (double) img.metadata.pixelarray_size_np / 1e6;
+        const size_t bmp_size = bbmp_image_calc_bytesize(&img),
+                     qoi_bound = bbmp_qoi_calc_bound(&img);
+
+        uint8_t *bmp = malloc(bmp_size),
+                *qoi = malloc(qoi_bound);
+        if (!bmp || !qoi) {
+            perror("bbmp_qoi_bench: Failed allocating memory");
+            return EXIT_FAILURE;
+        }
+
+        double bmp_enc = 0, bmp_dec = 0, qoi_enc = 0, qoi_dec = 0;
+        size_t qoi_size = 0;
+
+        for (long i = 0; i < iterations; i++) {
+            bbmp_Image decoded;
+            double t = bench_now();
+
+            bbmp_write_image(&img, bmp);
+            bmp_enc += bench_now() - t;
+
+            t = bench_now();
+            if (!bbmp_get_image(bmp, &decoded)) return EXIT_FAILURE;
+            bmp_dec += bench_now() - t;
+            bbmp_destroy_image(&decoded);
+
+            t = bench_now();
+            qoi_size = bbmp_qoi_encode(&img, qoi, qoi_bound);
+            qoi_enc += bench_now() - t;
+
+            t = bench_now();
+            if (!qoi_size || !bbmp_qoi_decode(qoi, qoi_size, &decoded)) return EXIT_FAILURE;
+            qoi_dec += bench_now() - t;
+            bbmp_destroy_image(&decoded);
+        }
+
+        char res[16];
+        snprintf(res, sizeof(res), "%dx%d", resolutions[r][0], resolutions[r][1]);
+
+        printf("%-11s %-4s %12zu %10.3f %12.1f %12.1f\n", res, "bmp", bmp_size, 1.0, pixel_mb * iterations / bmp_enc, pixel_mb * iterations / bmp_dec);
+        printf("%-11s %-4s %12zu %10.3f %12.1f %12.1f\n", res, "qoi", qoi_size, (double) qoi_size / bmp_size, pixel_mb * iterations / qoi_enc, pixel_mb * iterations / qoi_dec);
+
+        free(bmp);
+        free(qoi);
+        bbmp_destroy_image(&img);
+    }
+
+    return EXIT_SUCCESS;
+}
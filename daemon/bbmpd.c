@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "bbmp_parser.h"
+#include "bbmp_helper.h"
+#include "bbmpd.h"
+
+/*
+ * bbmpd: a long-running daemon that applies bbmp_utils transforms to images passed to it as memfds over a Unix domain socket.
+ * Usage: bbmpd [socket_path] [threads]
+ *
+ * The main thread owns the listening socket and every connection, and waits on all of them with epoll. Each request it reads is queued 
+ * together with its connection and served by one of the worker threads of a fixed pool, so idle clients never tie up a worker.
+ * Connections are registered with EPOLLONESHOT and only re-armed once their response has been sent, so requests on one connection 
+ * are still answered in order.
+*/
+
+#define BBMPD_QUEUE_SIZE (256) //maximum number of requests waiting for a worker
+#define BBMPD_MAX_EVENTS (64) //events handled per epoll_wait() call
+#define BBMPD_MAX_DIMENSION (1 << 15) //largest width/height accepted, both for input images and for enlarge
+#define BBMPD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) //seals every memfd passed in either direction must carry
+
+struct bbmpd_Job {
+    int conn; //connection the request arrived on, the response goes back there
+    int memfd; //memfd attached to the request, or -1
+    bbmpd_Request req;
+}; typedef struct bbmpd_Job bbmpd_Job;
+
+struct bbmpd_Queue {
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    bbmpd_Job jobs[BBMPD_QUEUE_SIZE];
+    size_t head, len;
+}; typedef struct bbmpd_Queue bbmpd_Queue;
+
+static bbmpd_Queue queue = {.lock = PTHREAD_MUTEX_INITIALIZER, .nonempty = PTHREAD_COND_INITIALIZER};
+static int epoll_fd = -1;
+static volatile sig_atomic_t running = 1;
+
+static void bbmpd_stop(int sig) {
+    running = 0;
+}
+
+static bool bbmpd_queue_push(const bbmpd_Job *job) {
+    pthread_mutex_lock(&queue.lock);
+
+    if (queue.len == BBMPD_QUEUE_SIZE) {
+        pthread_mutex_unlock(&queue.lock);
+        return false;
+    }
+
+    queue.jobs[(queue.head + queue.len++) % BBMPD_QUEUE_SIZE] = *job;
+    pthread_cond_signal(&queue.nonempty);
+    pthread_mutex_unlock(&queue.lock);
+
+    return true;
+}
+
+static void bbmpd_queue_pop(bbmpd_Job *job) {
+    pthread_mutex_lock(&queue.lock);
+
+    while (!queue.len) pthread_cond_wait(&queue.nonempty, &queue.lock);
+
+    *job = queue.jobs[queue.head];
+    queue.head = (queue.head + 1) % BBMPD_QUEUE_SIZE;
+    queue.len--;
+
+    pthread_mutex_unlock(&queue.lock);
+}
+
+static bool bbmpd_watch(int conn, int op) {
+    // (re-)arm "conn" for exactly one readiness notification, "op" is EPOLL_CTL_ADD or EPOLL_CTL_MOD
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.fd = conn};
+    return epoll_ctl(epoll_fd, op, conn, &ev) == 0;
+}
+
+static bool bbmpd_image_valid(const uint8_t *data, size_t size) {
+    /* 
+     * Check that the "size" bytes of "data" hold a BMP image the library can parse without reading out of bounds.
+    */
+
+    if (size < HEADER_BYTESIZE + BITMAPINFOHEADER_BYTESIZE) return false;
+
+    bbmp_Metadata meta;
+    bbmp_parse_bmp_metadata((unsigned char *) data, &meta);
+
+    if (memcmp(meta.header_iden, BITMAPINFOHEADER_STRING, 2) || (meta.bpp != 24 && meta.bpp != 32) || meta.compression_method) return false;
+    if (meta.pixelarray_width <= 0 || meta.pixelarray_height <= 0) return false;
+    if (meta.pixelarray_width > BBMPD_MAX_DIMENSION || meta.pixelarray_height > BBMPD_MAX_DIMENSION) return false;
+
+    return meta.pixelarray_off <= size && (uint64_t) meta.Bpr * meta.pixelarray_height <= size - meta.pixelarray_off;
+}
+
+static int bbmpd_apply(bbmp_Image *img, const bbmpd_Op *op) {
+    switch (op->code) {
+        case BBMPD_OP_ROT90:
+            if (op->arg0 != CW && op->arg0 != CCW) return BBMPD_ERR_REQUEST;
+            return bbmp_rot90(img, op->arg0) ? BBMPD_OK : BBMPD_ERR_OP;
+        case BBMPD_OP_GRAYSCALE:
+            return bbmp_grayscale(img) ? BBMPD_OK : BBMPD_ERR_OP;
+        case BBMPD_OP_VERTFLIP:
+            return bbmp_vertflip(img) ? BBMPD_OK : BBMPD_ERR_OP;
+        case BBMPD_OP_ENLARGE:
+            if (op->arg0 > BBMPD_MAX_DIMENSION || op->arg1 > BBMPD_MAX_DIMENSION) return BBMPD_ERR_OP;
+            return bbmp_enlarge_pixelarray(img, op->arg0, op->arg1, &op->fill) ? BBMPD_OK : BBMPD_ERR_OP;
+        default:
+            return BBMPD_ERR_REQUEST;
+    }
+}
+
+static int bbmpd_process(const bbmpd_Request *req, int memfd, int *result_memfd, size_t *result_size) {
+    /* 
+     * Map the image held by "memfd", apply all operations of "req" to it and write the result to a new memfd.
+     * The input mapping is private, so the client's memfd is never modified. The client can't modify it either: without the seals, 
+     * shrinking it after validation would turn reads of the mapping into SIGBUS.
+    */
+
+    const int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals == -1 || (seals & BBMPD_SEALS) != BBMPD_SEALS) return BBMPD_ERR_REQUEST;
+
+    struct stat st;
+    if (fstat(memfd, &st) == -1 || st.st_size <= 0) return BBMPD_ERR_IMAGE;
+
+    uint8_t *in = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, memfd, 0);
+    if (in == MAP_FAILED) return BBMPD_ERR_IMAGE;
+
+    if (!bbmpd_image_valid(in, st.st_size)) {
+        munmap(in, st.st_size);
+        return BBMPD_ERR_IMAGE;
+    }
+
+    bbmp_Image img;
+    bool parsed = bbmp_get_image(in, &img);
+    munmap(in, st.st_size);
+
+    if (!parsed) return BBMPD_ERR_INTERNAL;
+
+    int status = BBMPD_OK;
+    for (uint32_t i = 0; i < req->ops_num && status == BBMPD_OK; i++) {
+        status = bbmpd_apply(&img, &req->ops[i]);
+    }
+
+    if (status != BBMPD_OK) {
+        bbmp_destroy_image(&img);
+        return status;
+    }
+
+    bbmp_metaupdate(&img);
+    const size_t size = bbmp_image_calc_bytesize(&img);
+
+    int out_fd = memfd_create("bbmpd_result", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    uint8_t *out = MAP_FAILED;
+
+    if (out_fd != -1 && ftruncate(out_fd, size) == 0) {
+        out = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+    }
+
+    if (out == MAP_FAILED) {
+        if (out_fd != -1) close(out_fd);
+        bbmp_destroy_image(&img);
+        return BBMPD_ERR_INTERNAL;
+    }
+
+    bool written = bbmp_write_image(&img, out) != NULL;
+    munmap(out, size);
+    bbmp_destroy_image(&img);
+
+    if (!written || fcntl(out_fd, F_ADD_SEALS, BBMPD_SEALS) == -1) {
+        close(out_fd);
+        return BBMPD_ERR_INTERNAL;
+    }
+
+    *result_memfd = out_fd;
+    *result_size = size;
+
+    return BBMPD_OK;
+}
+
+static void bbmpd_respond(int conn, const bbmpd_Response *res, int result_memfd) {
+    /* 
+     * Send "res" (and "result_memfd", if not -1) back on "conn" and wait for the client's next request.
+     * Connections are non-blocking, so a client that stops reading its responses gets dropped instead of blocking the caller.
+    */
+
+    if (!bbmpd_send_msg(conn, res, sizeof(*res), result_memfd) || !bbmpd_watch(conn, EPOLL_CTL_MOD)) close(conn);
+}
+
+static void bbmpd_serve(bbmpd_Job *job) {
+    bbmpd_Response res = {.magic = BBMPD_MAGIC, .status = BBMPD_ERR_REQUEST};
+    int result_memfd = -1;
+    size_t result_size = 0;
+
+    if (job->req.magic == BBMPD_MAGIC && job->req.ops_num <= BBMPD_MAX_OPS && job->memfd != -1) {
+        res.status = bbmpd_process(&job->req, job->memfd, &result_memfd, &result_size);
+        res.size = result_size;
+    }
+
+    if (job->memfd != -1) close(job->memfd);
+
+    bbmpd_respond(job->conn, &res, result_memfd);
+    if (result_memfd != -1) close(result_memfd);
+}
+
+static void *bbmpd_worker(void *arg) {
+    bbmpd_Job job;
+
+    for (;;) {
+        bbmpd_queue_pop(&job);
+        bbmpd_serve(&job);
+    }
+
+    return NULL;
+}
+
+static void bbmpd_read_request(int conn) {
+    /* 
+     * Read the request "conn" just became readable for and queue it for the workers. 
+     * Disconnects and unparseable messages close the connection, which also removes it from the epoll set.
+    */
+
+    bbmpd_Job job = {.conn = conn};
+
+    if (!bbmpd_recv_msg(conn, &job.req, sizeof(job.req), &job.memfd)) {
+        close(conn);
+        return;
+    }
+
+    if (!bbmpd_queue_push(&job)) {
+        fprintf(stderr, "bbmpd: Request queue full, rejecting request\n");
+        if (job.memfd != -1) close(job.memfd);
+
+        bbmpd_respond(conn, &(bbmpd_Response) {.magic = BBMPD_MAGIC, .status = BBMPD_ERR_INTERNAL}, -1);
+    }
+}
+
+static void bbmpd_accept(int listener) {
+    // accept every pending connection on the non-blocking "listener"
+
+    for (;;) {
+        int conn = accept4(listener, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (conn == -1) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("bbmpd: Failed accepting connection");
+            return;
+        }
+
+        if (!bbmpd_watch(conn, EPOLL_CTL_ADD)) {
+            perror("bbmpd: Failed watching connection");
+            close(conn);
+        }
+    }
+}
+
+signed int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : BBMPD_DEFAULT_SOCKET;
+    long threads = argc > 2 ? strtol(argv[2], NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "bbmpd: Socket path too long: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listener == -1) {
+        perror("bbmpd: Failed creating socket");
+        return EXIT_FAILURE;
+    }
+
+    unlink(path);
+    if (bind(listener, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(listener, SOMAXCONN) == -1) {
+        perror("bbmpd: Failed binding socket");
+        close(listener);
+        return EXIT_FAILURE;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listener_ev = {.events = EPOLLIN, .data.fd = listener};
+    if (epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &listener_ev) == -1) {
+        perror("bbmpd: Failed setting up epoll");
+        close(listener);
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+
+    // no SA_RESTART, so that epoll_wait() is interrupted and the socket gets cleaned up
+    struct sigaction sa = {.sa_handler = bbmpd_stop};
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (long i = 0; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, bbmpd_worker, NULL) != 0) {
+            perror("bbmpd: Failed creating worker thread");
+            close(listener);
+            unlink(path);
+            return EXIT_FAILURE;
+        }
+        pthread_detach(thread);
+    }
+
+    fprintf(stderr, "bbmpd: Listening on %s with %ld worker threads\n", path, threads);
+
+    struct epoll_event events[BBMPD_MAX_EVENTS];
+
+    while (running) {
+        int ready = epoll_wait(epoll_fd, events, BBMPD_MAX_EVENTS, -1);
+        if (ready == -1) {
+            if (errno != EINTR) perror("bbmpd: Failed waiting for events");
+            continue;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.fd == listener) bbmpd_accept(listener);
+            else bbmpd_read_request(events[i].data.fd);
+        }
+    }
+
+    close(listener);
+    unlink(path);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "bbmp_helper.h"
+#include "bbmpd.h"
+
+/*
+ * Load generator for bbmpd. Every client thread opens its own connection and sends the same image (a single shared memfd) 
+ * through a fixed list of operations, then the total throughput and the mean request latency are reported.
+ * Usage: bbmpd_bench [socket_path] [clients] [requests_per_client] [width] [height]
+*/
+
+struct bbmpd_BenchClient {
+    const char *path;
+    int memfd;
+    size_t ops_num;
+    long requests;
+    long failed;
+    double latency_total; //sum of all request latencies, in seconds
+}; typedef struct bbmpd_BenchClient bbmpd_BenchClient;
+
+// rot90 only works on square images, so it comes last and is dropped for anything else
+static const bbmpd_Op bench_ops[] = {
+    {.code = BBMPD_OP_GRAYSCALE},
+    {.code = BBMPD_OP_VERTFLIP},
+    {.code = BBMPD_OP_ROT90, .arg0 = CW}
+};
+
+static double bbmpd_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *bbmpd_bench_client(void *arg) {
+    bbmpd_BenchClient *client = arg;
+
+    int sock = bbmpd_connect(client->path);
+    if (sock == -1) {
+        perror("bbmpd_bench: Failed connecting to daemon");
+        client->failed = client->requests;
+        return NULL;
+    }
+
+    for (long i = 0; i < client->requests; i++) {
+        int result_memfd;
+        size_t result_size;
+        const double start = bbmpd_now();
+
+        if (bbmpd_transform(sock, client->memfd, bench_ops, client->ops_num, &result_memfd, &result_size) != BBMPD_OK) {
+            client->failed++;
+            continue;
+        }
+
+        client->latency_total += bbmpd_now() - start;
+        close(result_memfd);
+    }
+
+    bbmpd_disconnect(sock);
+
+    return NULL;
+}
+
+signed int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : BBMPD_DEFAULT_SOCKET;
+    const long clients = argc > 2 ? strtol(argv[2], NULL, 10) : 4,
+               requests = argc > 3 ? strtol(argv[3], NULL, 10) : 1000;
+    const int32_t width = argc > 4 ? strtol(argv[4], NULL, 10) : 256,
+                  height = argc > 5 ? strtol(argv[5], NULL, 10) : width;
+
+    if (clients < 1 || requests < 1 || width < 1 || height < 1) {
+        fprintf(stderr, "usage: %s [socket_path] [clients] [requests_per_client] [width] [height]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bbmp_Image img;
+    if (!bbmp_create_image(width, height, 24, & (const bbmp_Pixel) {.r = 182, .g = 255, .b = 22}, &img)) return EXIT_FAILURE;
+
+    const size_t size = bbmp_image_calc_bytesize(&img);
+    uint8_t *raw = malloc(size);
+    if (!raw || !bbmp_write_image(&img, raw)) {
+        fprintf(stderr, "bbmpd_bench: Failed writing image\n");
+        bbmp_destroy_image(&img);
+        free(raw);
+        return EXIT_FAILURE;
+    }
+
+    int memfd = bbmpd_memfd_create(raw, size);
+    bbmp_destroy_image(&img);
+    free(raw);
+
+    if (memfd == -1) {
+        perror("bbmpd_bench: Failed creating memfd");
+        return EXIT_FAILURE;
+    }
+
+    bbmpd_BenchClient *state = calloc(clients, sizeof(bbmpd_BenchClient));
+    pthread_t *threads = calloc(clients, sizeof(pthread_t));
+    if (!state || !threads) {
+        perror("bbmpd_bench: Failed allocating memory");
+        return EXIT_FAILURE;
+    }
+
+    const double start = bbmpd_now();
+
+    for (long i = 0; i < clients; i++) {
+        state[i] = (bbmpd_BenchClient) {.path = path, .memfd = memfd, .requests = requests,
+                                        .ops_num = sizeof(bench_ops) / sizeof(bench_ops[0]) - (width != height)};
+        pthread_create(&threads[i], NULL, bbmpd_bench_client, &state[i]);
+    }
+
+    long failed = 0;
+    double latency_total = 0;
+    for (long i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        failed += state[i].failed;
+        latency_total += state[i].latency_total;
+    }
+
+    const double elapsed = bbmpd_now() - start;
+    const long done = clients * requests - failed;
+
+    printf("bbmpd_bench: %ldx%ld requests, %dx%d image, %ld failed\n", clients, requests, width, height, failed);
+    printf("bbmpd_bench: %.1f requests/s, %.3f ms mean latency, %.1f MiB/s of pixel data\n",
+           done / elapsed, done ? latency_total / done * 1e3 : 0.0, done * (double) size / elapsed / (1 << 20));
+
+    free(state);
+    free(threads);
+    close(memfd);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "bbmpd.h"
+
+/*
+ * Client library for bbmpd. Also provides the message helpers the daemon itself uses for passing file descriptors.
+*/
+
+bool bbmpd_send_msg(int sock, const void *msg, size_t size, int fd) {
+    /* 
+     * Send "size" bytes pointed to by "msg" as a single message over "sock". If "fd" isn't -1, it is attached as SCM_RIGHTS ancillary data.
+     * Returns true on success.
+    */
+
+    struct iovec iov = {.iov_base = (void *) msg, .iov_len = size};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr hdr = {.msg_iov = &iov, .msg_iovlen = 1};
+
+    if (fd != -1) {
+        memset(&control, 0, sizeof(control));
+        hdr.msg_control = control.buf;
+        hdr.msg_controllen = sizeof(control.buf);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t sent;
+    while ((sent = sendmsg(sock, &hdr, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+
+    return sent == (ssize_t) size;
+}
+
+bool bbmpd_recv_msg(int sock, void *msg, size_t size, int *fd) {
+    /* 
+     * Receive a single message of exactly "size" bytes from "sock" into "msg". If "fd" isn't NULL, an attached file descriptor is saved to *fd,
+     * or -1 if there was none. Returns false on failure, on a short or truncated message and when the peer closed the connection.
+    */
+
+    struct iovec iov = {.iov_base = msg, .iov_len = size};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr hdr = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control.buf)};
+
+    if (fd) *fd = -1;
+
+    ssize_t received;
+    while ((received = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR);
+
+    int passed = -1;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) memcpy(&passed, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    if (received != (ssize_t) size || (hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        if (passed != -1) close(passed);
+        return false;
+    }
+
+    if (fd) {
+        *fd = passed;
+    } else if (passed != -1) {
+        close(passed);
+    }
+
+    return true;
+}
+
+int bbmpd_connect(const char *socket_path) {
+    /* 
+     * Connect to the daemon listening on "socket_path" (BBMPD_DEFAULT_SOCKET if NULL). 
+     * Returns the connected socket, or -1 on failure. A single connection may be used for any number of sequential requests.
+    */
+
+    if (!socket_path) socket_path = BBMPD_DEFAULT_SOCKET;
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, socket_path);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock == -1) return -1;
+
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+void bbmpd_disconnect(int sock) {
+    if (sock != -1) close(sock);
+}
+
+int bbmpd_memfd_create(const uint8_t *raw_bmp_data, size_t size) {
+    /* 
+     * Create a memfd holding a copy of the "size" bytes of BMP file data pointed to by "raw_bmp_data", ready to be passed to bbmpd_transform().
+     * The memfd is sealed against writes and resizing, as the daemon requires. Callers producing images from scratch can avoid the copy
+     * by creating their own memfd with MFD_ALLOW_SEALING, writing into a mapping of it and sealing it the same way once it's unmapped.
+     * Returns the memfd, or -1 on failure.
+    */
+
+    int fd = memfd_create("bbmpd_image", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) return -1;
+
+    if (ftruncate(fd, size) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t *map = mmap(NULL, size, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    memcpy(map, raw_bmp_data, size);
+    munmap(map, size);
+
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int bbmpd_transform(int sock, int memfd, const bbmpd_Op *ops, size_t ops_num, int *result_memfd, size_t *result_size) {
+    /* 
+     * Ask the daemon connected to "sock" to apply "ops_num" operations pointed to by "ops" to the BMP image held by "memfd".
+     * The input memfd is only read by the daemon and may be reused for further requests. On success, a new memfd holding the transformed 
+     * BMP file data is saved to *result_memfd (to be closed by the caller) and its size to *result_size.
+     * Returns BBMPD_OK on success, another enum bbmpd_Status value reported by the daemon, or -1 on a transport error.
+    */
+
+    if (sock == -1 || memfd == -1 || (!ops && ops_num) || ops_num > BBMPD_MAX_OPS || !result_memfd || !result_size) return -1;
+
+    bbmpd_Request req = {.magic = BBMPD_MAGIC, .ops_num = ops_num};
+    if (ops_num) memcpy(req.ops, ops, ops_num * sizeof(bbmpd_Op));
+
+    if (!bbmpd_send_msg(sock, &req, sizeof(req), memfd)) return -1;
+
+    bbmpd_Response res;
+    int fd;
+    if (!bbmpd_recv_msg(sock, &res, sizeof(res), &fd) || res.magic != BBMPD_MAGIC) {
+        if (fd != -1) close(fd);
+        return -1;
+    }
+
+    if (res.status != BBMPD_OK || fd == -1) {
+        if (fd != -1) close(fd);
+        return res.status != BBMPD_OK ? res.status : -1;
+    }
+
+    *result_memfd = fd;
+    *result_size = res.size;
+
+    return BBMPD_OK;
+}
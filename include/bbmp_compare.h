@@ -0,0 +1,20 @@
+#pragma once
+
+#include "bbmp_helper.h"
+
+/*
+ * Result of an exact comparison of two images. 
+ * Coordinates are pixelarray coordinates: "x" is the column and "y" the row, with rows counted from the bottom of the image, in the order they are stored in the file.
+*/
+struct bbmp_Diff {
+    bool identical; //true if all pixels of both images are equal, in which case the rest of the fields are zeroed
+    int32_t first_x, first_y; //the first differing pixel, in storage (row-major) order
+    int32_t min_x, min_y, max_x, max_y; //inclusive bounding box of all differing pixels
+}; typedef struct bbmp_Diff bbmp_Diff;
+
+bool bbmp_diff(const bbmp_Image *a, const bbmp_Image *b, bool first_only, bbmp_Diff *result); 
+bool bbmp_diff_raw(const uint8_t *raw_a, const uint8_t *raw_b, bool first_only, bbmp_Diff *result); 
+bool bbmp_psnr(const bbmp_Image *a, const bbmp_Image *b, double *mse, double *psnr); 
+bool bbmp_psnr_raw(const uint8_t *raw_a, const uint8_t *raw_b, double *mse, double *psnr); 
+bool bbmp_ssim(const bbmp_Image *a, const bbmp_Image *b, double *ssim); 
+bool bbmp_ssim_raw(const uint8_t *raw_a, const uint8_t *raw_b, double *ssim); 
@@ -19,22 +19,104 @@ struct bbmp_Pixel {
 
 typedef bbmp_Pixel **bbmp_PixelArray;
 
+struct bbmp_Storage; //reference count of pixel storage shared between views, opaque
+
 /*
  * A helper API structure designed to represent a full BMP image.
 */
 struct bbmp_Image {
     struct bbmp_Metadata metadata; //metadata associated with the above pixelarray
-    bbmp_PixelArray pixelarray; //a pixelarray in a parsed, easily consumable format
+    bbmp_PixelArray pixelarray; //a pixelarray in a parsed, easily consumable format, holds rows_capacity row pointers into pixelbuf
+    bbmp_Pixel *pixelbuf; //contiguous storage that the rows of the pixelarray point into
+    struct bbmp_Storage *storage; //reference count of pixelbuf, shared with the views of this image (see bbmp_view)
+    size_t stride; //capacity of a single row of pixelbuf, in pixels
+    size_t rows_capacity; //number of rows pixelbuf has room for
 }; typedef struct bbmp_Image bbmp_Image;
 
+#define BBMP_PLANE_ALIGNMENT (64) //alignment (in bytes) of every plane row of a bbmp_PlanarImage, enough for the widest vector units
+
+/*
+ * Same as bbmp_image_calc_bytesize, but for the BMP image that bbmp_interleave_raw() writes for the planar image `pimg`.
+*/
+#define bbmp_planar_calc_bytesize(pimg) ((HEADER_BYTESIZE) + (BITMAPINFOHEADER_BYTESIZE) + (((pimg)->a ? 32 : 24) * (size_t) (pimg)->width + 31) / 32 * 4 * (pimg)->height)
+
+/*
+ * Optional planar (structure-of-arrays) representation of an image: every channel is stored in its own plane, 
+ * so that per-channel operations can process full vector registers of a single channel without shuffling.
+ * Planes are stored bottom-up, like the rows of a bbmp_PixelArray.
+*/
+struct bbmp_PlanarImage {
+    int32_t width, height; //dimensions of every plane, in pixels
+    size_t stride; //bytes per plane row, a multiple of BBMP_PLANE_ALIGNMENT
+    uint8_t *r, *g, *b; //color planes, each `stride * height` bytes large
+    uint8_t *a; //alpha plane, NULL if the image has no alpha channel
+}; typedef struct bbmp_PlanarImage bbmp_PlanarImage;
+
+enum bbmp_Layout {BBMP_LAYOUT_PACKED, BBMP_LAYOUT_PLANAR};
+
+/*
+ * A reference to an image in either layout, accepted by the userspace functions that support both.
+*/
+struct bbmp_ImageRef {
+    enum bbmp_Layout layout;
+    union {
+        bbmp_Image *packed;
+        bbmp_PlanarImage *planar;
+    };
+}; typedef struct bbmp_ImageRef bbmp_ImageRef;
+
+/*
+ * Per-channel value tables, indexed as channel[c][value] with channels in r, g, b order.
+*/
+struct bbmp_Histogram {
+    uint32_t channel[3][256]; //number of occurences of every value
+}; typedef struct bbmp_Histogram bbmp_Histogram;
+
+struct bbmp_Lut {
+    uint8_t channel[3][256]; //value that every value is replaced with
+}; typedef struct bbmp_Lut bbmp_Lut;
+
+// channel masks selecting which tables of a bbmp_Lut a point operation is composed into
+#define BBMP_CHANNEL_R (1u << 0)
+#define BBMP_CHANNEL_G (1u << 1)
+#define BBMP_CHANNEL_B (1u << 2)
+#define BBMP_CHANNEL_RGB (BBMP_CHANNEL_R | BBMP_CHANNEL_G | BBMP_CHANNEL_B)
+
+#define BBMP_PACKED_REF(img) ((bbmp_ImageRef) {.layout = BBMP_LAYOUT_PACKED, .packed = (img)})
+#define BBMP_PLANAR_REF(img) ((bbmp_ImageRef) {.layout = BBMP_LAYOUT_PLANAR, .planar = (img)})
+
 enum clock_dir {CW, CCW};
 
+enum bbmp_Sampling {BBMP_SAMPLE_NEAREST, BBMP_SAMPLE_BILINEAR};
+
+/*
+ * A 2x3 affine transformation matrix mapping pixelarray coordinates (x, y) of a source image to (m[0][0] * x + m[0][1] * y + m[0][2], m[1][0] * x + m[1][1] * y + m[1][2])
+ * in the destination image. Coordinates refer to pixel centers, with rows counted from the bottom of the image like the rows of a bbmp_PixelArray.
+*/
+struct bbmp_Affine {
+    double m[2][3];
+}; typedef struct bbmp_Affine bbmp_Affine;
+
 bool bbmp_get_image(uint8_t *raw_bmp_data, bbmp_Image *location); 
 bbmp_Image *bbmp_create_image(int32_t pixelarray_width, int32_t pixelarray_height, uint16_t bpp, const bbmp_Pixel *fill, bbmp_Image *location); 
 bool bbmp_destroy_image(bbmp_Image *location);
 uint8_t *bbmp_write_image(const bbmp_Image *location, uint8_t *raw_bmp_data); 
 bool bbmp_enlarge_pixelarray(bbmp_Image *img, int32_t width, int32_t height, const bbmp_Pixel *fill); 
+bool bbmp_resize_canvas(bbmp_Image *img, int32_t left, int32_t right, int32_t bottom, int32_t top, const bbmp_Pixel *fill); 
+bbmp_Image *bbmp_copy_rect(const bbmp_Image *src, int32_t x, int32_t y, int32_t width, int32_t height, bbmp_Image *location); 
+bool bbmp_crop(bbmp_Image *img, int32_t x, int32_t y, int32_t width, int32_t height); 
+bool bbmp_paste(bbmp_Image *dest, const bbmp_Image *src, int32_t x, int32_t y); 
+bool bbmp_write_mosaic(FILE *stream, const bbmp_Image *const *tiles, size_t count, size_t columns, const bbmp_Pixel *fill); 
 bool bbmp_metaupdate(bbmp_Image *meta);
+bbmp_Image *bbmp_view(bbmp_Image *src, int32_t x, int32_t y, int32_t width, int32_t height, bbmp_Image *location); 
+bool bbmp_make_unique(bbmp_Image *img); 
+bool bbmp_is_shared(const bbmp_Image *img); 
+bbmp_PlanarImage *bbmp_create_planar(int32_t width, int32_t height, bool alpha, bbmp_PlanarImage *location); 
+bool bbmp_destroy_planar(bbmp_PlanarImage *location); 
+bbmp_PlanarImage *bbmp_deinterleave(const bbmp_Image *img, bbmp_PlanarImage *location); 
+bbmp_Image *bbmp_interleave(const bbmp_PlanarImage *planar, bbmp_Image *location); 
+bbmp_PlanarImage *bbmp_deinterleave_raw(const uint8_t *raw_bmp_data, bbmp_PlanarImage *location); 
+uint8_t *bbmp_interleave_raw(const bbmp_PlanarImage *planar, uint8_t *raw_bmp_data); 
 bool bbmp_debug_pixelarray(FILE *stream, const bbmp_Image *location, bool baseten); 
 void bbmp_debug_pixel(const bbmp_Pixel *pixel); 
 
@@ -42,3 +124,16 @@ void bbmp_debug_pixel(const bbmp_Pixel *pixel);
 bbmp_Image *bbmp_rot90(bbmp_Image *image, const enum clock_dir direction); 
 bbmp_Image *bbmp_grayscale(bbmp_Image *image); 
 bbmp_Image *bbmp_vertflip(bbmp_Image *image); 
+bbmp_PlanarImage *bbmp_grayscale_planar(bbmp_PlanarImage *image); 
+bool bbmp_histogram(bbmp_ImageRef image, bbmp_Histogram *histogram); 
+bool bbmp_apply_lut(bbmp_ImageRef image, const bbmp_Lut *lut); 
+bbmp_Lut *bbmp_lut_identity(bbmp_Lut *lut); 
+bbmp_Lut *bbmp_lut_gamma(bbmp_Lut *lut, unsigned channels, double gamma); 
+bbmp_Lut *bbmp_lut_brightness(bbmp_Lut *lut, unsigned channels, int delta); 
+bbmp_Lut *bbmp_lut_contrast(bbmp_Lut *lut, unsigned channels, double factor); 
+bbmp_Lut *bbmp_lut_levels(bbmp_Lut *lut, unsigned channels, uint8_t in_black, uint8_t in_white, double gamma, uint8_t out_black, uint8_t out_white); 
+bbmp_Lut *bbmp_lut_invert(bbmp_Lut *lut, unsigned channels); 
+bbmp_Lut *bbmp_lut_equalize(bbmp_Lut *lut, unsigned channels, const bbmp_Histogram *histogram); 
+bbmp_Affine *bbmp_affine_rotation(bbmp_Affine *affine, double degrees, double cx, double cy); 
+bbmp_Image *bbmp_warp_affine(const bbmp_Image *src, const bbmp_Affine *affine, int32_t width, int32_t height, const bbmp_Pixel *fill, enum bbmp_Sampling sampling, bbmp_Image *location); 
+bbmp_Image *bbmp_rotate(const bbmp_Image *src, double degrees, const bbmp_Pixel *fill, enum bbmp_Sampling sampling, bbmp_Image *location); 
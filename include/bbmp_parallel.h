@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Internal helper for splitting row-based work into contiguous bands and running each band on its own thread.
+ * Not installed alongside the public headers.
+*/
+
+#define BBMP_PARALLEL_MAX_BANDS (64) //upper bound on the number of bands (and thus threads) a single call is split into
+
+/*
+ * Work function called once per band, with "begin" inclusive and "end" exclusive. "band" is the index of the band, in order,
+ * and is always lower than the band count bbmp_parallel_for() returns (which equals bbmp_parallel_bands() for the same "n" and "grain").
+*/
+typedef void (*bbmp_ParallelFn)(void *ctx, size_t band, size_t begin, size_t end);
+
+size_t bbmp_parallel_bands(size_t n, size_t grain); 
+size_t bbmp_parallel_for(size_t n, size_t grain, bbmp_ParallelFn fn, void *ctx); 
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "bbmp_helper.h"
+
+/*
+ * Lossless import/export of images in the QOI ("Quite OK Image") format, see https://qoiformat.org/qoi-specification.pdf
+ * Only 3-channel (RGB) QOI images are written; 4-channel images are read as well, but their alpha channel is dropped.
+*/
+
+#define BBMP_QOI_HEADER_BYTESIZE (14)
+#define BBMP_QOI_END_BYTESIZE (8)
+
+/*
+ * Largest number of pixels (width * height) of a QOI image, as recommended by the specification so that decoders can bound their 
+ * allocations. Applies both ways: larger images are neither encoded nor decoded.
+*/
+#define BBMP_QOI_MAX_PIXELS (400000000)
+
+/*
+ * Worst-case size (in bytes) of the QOI encoding of the image represented by `img`, where every pixel needs a full QOI_OP_RGB chunk.
+*/
+#define bbmp_qoi_calc_bound(img) ((BBMP_QOI_HEADER_BYTESIZE) + (size_t) (img)->metadata.pixelarray_width * (img)->metadata.pixelarray_height * 4 + (BBMP_QOI_END_BYTESIZE))
+
+size_t bbmp_qoi_encode(const bbmp_Image *img, uint8_t *buffer, size_t size); 
+bbmp_Image *bbmp_qoi_decode(const uint8_t *data, size_t size, bbmp_Image *location); 
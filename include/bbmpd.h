@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bbmp_helper.h"
+
+/*
+ * Wire protocol and client API of bbmpd, the local image transform daemon.
+ *
+ * Clients connect to the daemon's SOCK_SEQPACKET Unix domain socket and send a single bbmpd_Request per message, with a memfd 
+ * holding the entire BMP file data attached as SCM_RIGHTS ancillary data. The daemon replies with a bbmpd_Response, and on success 
+ * attaches a new memfd holding the transformed BMP file data. Pixel data is only ever passed around as file descriptors, never through the socket itself.
+ *
+ * Request memfds must carry the F_SEAL_SHRINK, F_SEAL_GROW and F_SEAL_WRITE seals (bbmpd_memfd_create() applies them), so the image 
+ * can't change under the daemon after it has been validated; unsealed memfds are rejected with BBMPD_ERR_REQUEST. Result memfds are sealed the same way.
+*/
+
+#define BBMPD_DEFAULT_SOCKET "/tmp/bbmpd.sock"
+#define BBMPD_MAGIC (0x444d4242) //"BBMD"
+#define BBMPD_MAX_OPS (16) //maximum number of operations per request
+
+enum bbmpd_OpCode {
+    BBMPD_OP_ROT90 = 1, //arg0: enum clock_dir
+    BBMPD_OP_GRAYSCALE = 2,
+    BBMPD_OP_VERTFLIP = 3,
+    BBMPD_OP_ENLARGE = 4 //arg0: new width, arg1: new height, fill: reference pixel of the new rows/columns
+};
+
+struct bbmpd_Op {
+    uint32_t code; //one of enum bbmpd_OpCode
+    int32_t arg0, arg1;
+    bbmp_Pixel fill;
+}; typedef struct bbmpd_Op bbmpd_Op;
+
+struct bbmpd_Request {
+    uint32_t magic; //always BBMPD_MAGIC
+    uint32_t ops_num; //number of valid entries in ops, at most BBMPD_MAX_OPS
+    bbmpd_Op ops[BBMPD_MAX_OPS]; //operations, applied in order
+}; typedef struct bbmpd_Request bbmpd_Request;
+
+enum bbmpd_Status {
+    BBMPD_OK = 0,
+    BBMPD_ERR_REQUEST = 1, //malformed request, missing or unsealed memfd
+    BBMPD_ERR_IMAGE = 2, //the memfd doesn't hold a supported BMP image
+    BBMPD_ERR_OP = 3, //an operation failed (e.g. rot90 on a non-square image)
+    BBMPD_ERR_INTERNAL = 4 //out of memory or a failed system call
+};
+
+struct bbmpd_Response {
+    uint32_t magic; //always BBMPD_MAGIC
+    int32_t status; //one of enum bbmpd_Status, a memfd is attached only if this is BBMPD_OK
+    uint64_t size; //size of the BMP file data in the attached memfd
+}; typedef struct bbmpd_Response bbmpd_Response;
+
+// client API (libbbmpdclient)
+int bbmpd_connect(const char *socket_path); 
+void bbmpd_disconnect(int sock); 
+int bbmpd_memfd_create(const uint8_t *raw_bmp_data, size_t size); 
+int bbmpd_transform(int sock, int memfd, const bbmpd_Op *ops, size_t ops_num, int *result_memfd, size_t *result_size); 
+bool bbmpd_send_msg(int sock, const void *msg, size_t size, int fd); 
+bool bbmpd_recv_msg(int sock, void *msg, size_t size, int *fd); 